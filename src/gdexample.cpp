@@ -1,10 +1,16 @@
 #include "gdexample.h"
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
 #include <godot_cpp/classes/array_mesh.hpp>
 #include <godot_cpp/classes/immediate_mesh.hpp>
 #include <godot_cpp/classes/mesh.hpp>
 #include <godot_cpp/classes/node.hpp>
 #include <godot_cpp/classes/orm_material3d.hpp>
+#include <godot_cpp/classes/rendering_server.hpp>
 #include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
 #include <godot_cpp/variant/packed_int32_array.hpp>
 #include <godot_cpp/variant/packed_vector3_array.hpp>
 
@@ -19,8 +25,9 @@ PackedVector3Array convertVector(const std::vector<ewdg::Vector3> &vec) {
   PackedVector3Array packed_array;
   packed_array.resize(vec.size());
 
-  for (int i = 0; i < vec.size(); ++i) {
-    packed_array.set(i, Vector3(vec[i].x, vec[i].y, vec[i].z));
+  Vector3 *dst = packed_array.ptrw();
+  for (size_t i = 0; i < vec.size(); ++i) {
+    dst[i] = Vector3(vec[i].x, vec[i].y, vec[i].z);
   }
 
   return packed_array;
@@ -30,13 +37,68 @@ PackedInt32Array convertInt(const std::vector<int32_t> &vec) {
   PackedInt32Array packed_array;
   packed_array.resize(vec.size());
 
-  for (int i = 0; i < vec.size(); ++i) {
-    packed_array.set(i, vec[i]);
-  }
+  std::copy(vec.begin(), vec.end(), packed_array.ptrw());
 
   return packed_array;
 }
 
+Dictionary GDExample::get_profile() const {
+  Dictionary result;
+  if (!ewdg::Profiler::enabled)
+    return result;
+  for (uint32_t s = 0; s < ewdg::PROFILE_STAGE_COUNT; s++) {
+    ewdg::ProfileStage stage = static_cast<ewdg::ProfileStage>(s);
+    result[String(ewdg::Profile::stage_name(stage)) + "_ms"] =
+        profile.stage_ms[s];
+  }
+  for (uint32_t c = 0; c < ewdg::PROFILE_COUNTER_COUNT; c++) {
+    ewdg::ProfileCounter counter = static_cast<ewdg::ProfileCounter>(c);
+    result[ewdg::Profile::counter_name(counter)] =
+        static_cast<int64_t>(profile.counters[c]);
+  }
+  return result;
+}
+
+Dictionary GDExample::get_simulation_stats() const {
+  static const char *ends[] = {"running", "at_rest", "low_energy",
+                               "step_limit"};
+  Dictionary result;
+  result["steps"] = static_cast<int64_t>(simulation.steps);
+  result["end"] = ends[simulation.end];
+  return result;
+}
+
+// Builds the finished dungeon's mesh from a worker snapshot. The worker
+// wrote the vertices as packed floats, so they are copied in one go.
+Ref<ArrayMesh>
+GDExample::dungeon_surface_mesh(const ewdg::GenerationSnapshot &result) {
+  static_assert(sizeof(Vector3) == 3 * sizeof(real_t),
+                "expects tightly packed Vector3");
+  PackedVector3Array vertices;
+  PackedInt32Array indices;
+  vertices.resize(result.vertices.size() / 3);
+  indices.resize(result.indices.size());
+  real_t *dst = reinterpret_cast<real_t *>(vertices.ptrw());
+  if constexpr (std::is_same<real_t, float>::value) {
+    std::memcpy(dst, result.vertices.data(),
+                result.vertices.size() * sizeof(float));
+  } else {
+    std::copy(result.vertices.begin(), result.vertices.end(), dst);
+  }
+  std::memcpy(indices.ptrw(), result.indices.data(),
+              result.indices.size() * sizeof(int32_t));
+
+  auto surface_array = Array();
+  surface_array.resize(Mesh::ArrayType::ARRAY_MAX);
+  surface_array[Mesh::ArrayType::ARRAY_VERTEX] = vertices;
+  surface_array[Mesh::ArrayType::ARRAY_INDEX] = indices;
+  Ref<ArrayMesh> mesh;
+  mesh.instantiate();
+  mesh->add_surface_from_arrays(Mesh::PrimitiveType::PRIMITIVE_TRIANGLES,
+                                surface_array);
+  return mesh;
+}
+
 GDExample::~GDExample() {
   // Add your cleanup here.
 }
@@ -64,81 +126,161 @@ void GDExample::line(ewdg::Vector3 pos1, ewdg::Vector3 pos2, Color c) {
   mesh_instances.push_back(mesh_instance);
 }
 
-void GDExample::_ready() {
-  auto surface_array = Array();
-  surface_array.resize(Mesh::ArrayType::ARRAY_MAX);
-  d.generate_rooms(room_to_be_generated, min_max_room_width.x,
-                   min_max_room_width.y);
-  // d.simulate_rooms(repultion_force, friction_force, simulation_timestep);
-  //
-  // d.make_graf_layout(25, 10);
-  // std::printf("Graf edges: %zi", d.delaunay.edges.size());
-  // for (ewdg::Edge<ewdg::Room> e : d.dungeon_layout) {
-  // auto pos1 = ewdg::Vector3(e.from->position.x, 0, e.from->position.y);
-  // auto pos2 = ewdg::Vector3(e.to->position.x, 0, e.to->position.y);
-  // line(pos1, pos2);
-  //}
-  //
-  // d.generate_paths();
-
-  auto room_mesh = d.generate_mesh(true);
-
-  surface_array[Mesh::ArrayType::ARRAY_VERTEX] = convertVector(room_mesh.first);
-  surface_array[Mesh::ArrayType::ARRAY_INDEX] = convertInt(room_mesh.second);
-  auto _mesh = new ArrayMesh();
-  _mesh->add_surface_from_arrays(Mesh::PrimitiveType::PRIMITIVE_TRIANGLES,
-                                 surface_array);
-  set_mesh(_mesh);
+// All edges in one line mesh, so installing the layout costs one node
+void GDExample::draw_layout(const ewdg::GenerationSnapshot &snapshot) {
+  auto mesh_instance = new MeshInstance3D();
+  auto immediate_mesh = new ImmediateMesh();
+  auto material = new ORMMaterial3D();
+
+  mesh_instance->set_mesh(immediate_mesh);
+  mesh_instance->set_cast_shadows_setting(
+      GeometryInstance3D::ShadowCastingSetting::SHADOW_CASTING_SETTING_OFF);
+
+  immediate_mesh->surface_begin(Mesh::PRIMITIVE_LINES, material);
+  for (const ewdg::GraphEdge &e : snapshot.layout.edges) {
+    const ewdg::Vector2 &from = snapshot.main_rooms[e.from].position;
+    const ewdg::Vector2 &to = snapshot.main_rooms[e.to].position;
+    immediate_mesh->surface_add_vertex(Vector3(from.x, 0, from.y));
+    immediate_mesh->surface_add_vertex(Vector3(to.x, 0, to.y));
+  }
+  immediate_mesh->surface_end();
+
+  material->set_shading_mode(
+      BaseMaterial3D::ShadingMode::SHADING_MODE_UNSHADED);
+  material->set_albedo(Color(1, 0, 0, 1));
+
+  add_child(mesh_instance);
+
+  mesh_instances.push_back(mesh_instance);
 }
 
-void GDExample::_process(double delta) {
-  if (dungeon_done)
-    return;
+void GDExample::clear_lines() {
+  for (auto &l : mesh_instances) {
+    remove_child(l);
+    delete l;
+  }
+  mesh_instances.clear();
+}
 
-  timer -= delta;
-  if (!simulation_done) {
-    simulation_done =
-        d.time_step_rooms(repultion_force, friction_force, simulation_timestep);
+void GDExample::start_generation() {
+  ewdg::DungeonParams params;
+  params.seed = seed;
+  params.room_count = room_to_be_generated;
+  params.main_room_count = main_room_count;
+  params.min_room_width = min_max_room_width.x;
+  params.max_room_width = min_max_room_width.y;
+  params.repulsion_force = repultion_force;
+  params.friction_force = friction_force;
+  params.simulation_timestep = simulation_timestep;
+  params.solver = solver == ewdg::SOLVER_POSITIONS ? ewdg::SOLVER_POSITIONS
+                                                   : ewdg::SOLVER_FORCES;
+  params.solver_relaxation = solver_relaxation;
 
-    auto room_mesh = d.generate_mesh(false);
-    auto surface_array = Array();
-    surface_array.resize(Mesh::ArrayType::ARRAY_MAX);
-    surface_array[Mesh::ArrayType::ARRAY_VERTEX] =
-        convertVector(room_mesh.first);
-    surface_array[Mesh::ArrayType::ARRAY_INDEX] = convertInt(room_mesh.second);
-    auto _mesh = new ArrayMesh();
-    _mesh->add_surface_from_arrays(Mesh::PrimitiveType::PRIMITIVE_TRIANGLES,
-                                   surface_array);
-    set_mesh(_mesh);
-  } else if (!graf_done) {
-    d.make_graf_layout(25, 10);
-    std::printf("Graf edges: %zi", d.delaunay.edges.size());
-    for (ewdg::Edge<ewdg::Room> e : d.dungeon_layout) {
-      auto pos1 = ewdg::Vector3(e.from->position.x, 0, e.from->position.y);
-      auto pos2 = ewdg::Vector3(e.to->position.x, 0, e.to->position.y);
-      line(pos1, pos2);
-    }
+  clear_lines();
+  dungeon_mesh.unref();
+  // The next simulation snapshot rebuilds the preview and shows it again
+  preview_mesh.unref();
+  dungeon_done = false;
+  run = generator.start(params);
+}
 
-    d.generate_paths();
-    graf_done = true;
-    timer = 2;
-  } else if (!dungeon_done && timer < 0) {
-    auto room_mesh = d.generate_mesh(true);
+// Restarts a running or finished generation with the new parameters. The
+// old run is cancelled, its snapshots are dropped by _process.
+void GDExample::parameters_changed() {
+  if (is_inside_tree())
+    start_generation();
+}
+
+void GDExample::_ready() { start_generation(); }
+
+void GDExample::_exit_tree() { generator.cancel(); }
+
+// Uploads the rooms of the running simulation. The mesh is only created
+// once, afterwards the vertices of rooms that moved are written into the
+// existing vertex buffer.
+void GDExample::update_preview_mesh(const std::vector<ewdg::Room> &rooms) {
+  if (preview_mesh.is_null() || !preview.matches(rooms)) {
+    preview.build(rooms);
     auto surface_array = Array();
     surface_array.resize(Mesh::ArrayType::ARRAY_MAX);
     surface_array[Mesh::ArrayType::ARRAY_VERTEX] =
-        convertVector(room_mesh.first);
-    surface_array[Mesh::ArrayType::ARRAY_INDEX] = convertInt(room_mesh.second);
-    auto _mesh = new ArrayMesh();
-    _mesh->add_surface_from_arrays(Mesh::PrimitiveType::PRIMITIVE_TRIANGLES,
-                                   surface_array);
-    set_mesh(_mesh);
-    for (auto &l : mesh_instances) {
-      remove_child(l);
-      delete l;
+        convertVector(preview.vertices);
+    surface_array[Mesh::ArrayType::ARRAY_INDEX] = convertInt(preview.indices);
+    preview_mesh.instantiate();
+    preview_mesh->add_surface_from_arrays(
+        Mesh::PrimitiveType::PRIMITIVE_TRIANGLES, surface_array);
+    set_mesh(preview_mesh);
+    return;
+  }
+
+  const auto &ranges = preview.update(rooms);
+  if (ranges.empty())
+    return;
+
+  RenderingServer *rs = RenderingServer::get_singleton();
+  int64_t stride = rs->mesh_surface_get_format_vertex_stride(
+      static_cast<int64_t>(preview_mesh->surface_get_format(0)),
+      preview.vertices.size());
+  if (stride != static_cast<int64_t>(3 * sizeof(float))) {
+    // Positions are not tightly packed, fall back to a full rebuild
+    preview_mesh.unref();
+    update_preview_mesh(rooms);
+    return;
+  }
+
+  PackedByteArray region;
+  for (const auto &range : ranges) {
+    region.resize(range.second * stride);
+    float *dst = reinterpret_cast<float *>(region.ptrw());
+    for (size_t i = 0; i < range.second; i++) {
+      const ewdg::Vector3 &v = preview.vertices[range.first + i];
+      dst[3 * i] = v.x;
+      dst[3 * i + 1] = v.y;
+      dst[3 * i + 2] = v.z;
     }
+    rs->mesh_surface_update_vertex_region(preview_mesh->get_rid(), 0,
+                                          range.first * stride, region);
+  }
+
+  // The bounds are not updated with the vertex region, keep culling correct.
+  // PreviewMesh grows them while writing the moved rooms.
+  auto bounds = preview.bounds();
+  Vector3 min(bounds.first.x, bounds.first.y, bounds.first.z);
+  Vector3 max(bounds.second.x, bounds.second.y, bounds.second.z);
+  preview_mesh->set_custom_aabb(AABB(min, max - min));
+}
 
-    mesh_instances.clear();
+// Installs at most the newest snapshot per frame, so the time spent here
+// stays bounded however fast the worker publishes
+void GDExample::_process(double delta) {
+  timer -= delta;
+  if (dungeon_mesh.is_valid() && timer < 0) {
+    // The layout lines stay visible for a moment before the mesh replaces
+    // them
+    set_mesh(dungeon_mesh);
+    dungeon_mesh.unref();
+    clear_lines();
+  }
+  if (dungeon_done)
+    return;
+
+  const ewdg::GenerationSnapshot *snapshot = generator.poll();
+  if (!snapshot || snapshot->run != run)
+    return;
+
+  switch (snapshot->stage) {
+  case ewdg::GENERATION_SIMULATING:
+    update_preview_mesh(snapshot->rooms);
+    break;
+  case ewdg::GENERATION_LAYOUT:
+    draw_layout(*snapshot);
+    timer = 2;
+    break;
+  case ewdg::GENERATION_DONE:
+    dungeon_mesh = dungeon_surface_mesh(*snapshot);
+    profile = snapshot->profile;
+    simulation = snapshot->simulation;
     dungeon_done = true;
+    break;
   }
 }
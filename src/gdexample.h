@@ -1,8 +1,12 @@
 #ifndef GDEXAMPLE_H
 #define GDEXAMPLE_H
 
+#include "libs/ewdg/async_generator.h"
 #include "libs/ewdg/ewdg.h"
+#include "libs/ewdg/preview_mesh.h"
+#include <godot_cpp/classes/array_mesh.hpp>
 #include <godot_cpp/classes/mesh_instance3d.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
 
 namespace godot {
 
@@ -11,18 +15,31 @@ class GDExample : public MeshInstance3D {
 
 private:
   double timer;
+  int64_t seed = 0;
   int room_to_be_generated = 50, main_room_count = 25;
   double simulation_timestep = 0.1;
   double repultion_force = 1;
   double friction_force = 0.5;
+  int64_t solver = ewdg::SOLVER_FORCES;
+  double solver_relaxation = 1.9;
   Vector2 min_max_room_width = {5, 20};
-  ewdg::Dungeon d;
-  bool simulation_done = false;
-  bool graf_done = false;
+  // Generation runs on the generator's thread, _process installs the
+  // snapshots it publishes
+  ewdg::AsyncGenerator generator;
+  uint64_t run = 0;
   bool dungeon_done = false;
+  Ref<ArrayMesh> dungeon_mesh;
+  ewdg::Profile profile;
+  ewdg::SimulationStats simulation;
 
 protected:
   static void _bind_methods() {
+    // Generation seed
+    ClassDB::bind_method(D_METHOD("get_seed"), &GDExample::get_seed);
+    ClassDB::bind_method(D_METHOD("set_seed", "p_seed"), &GDExample::set_seed);
+    ClassDB::add_property("GDExample", PropertyInfo(Variant::INT, "seed"),
+                          "set_seed", "get_seed");
+
     // Rooms to be generated
     ClassDB::bind_method(D_METHOD("get_rooms_to_be_generated"),
                          &GDExample::get_rooms_to_be_generated);
@@ -85,6 +102,31 @@ protected:
                           PropertyInfo(Variant::FLOAT, "friction_force",
                                        PROPERTY_HINT_RANGE, "0.001,10,0.001"),
                           "set_friction_force", "get_friction_force");
+
+    // Separation solver, see ewdg::Dungeon::solver
+    ClassDB::bind_method(D_METHOD("get_solver"), &GDExample::get_solver);
+    ClassDB::bind_method(D_METHOD("set_solver", "p_solver"),
+                         &GDExample::set_solver);
+    ClassDB::add_property("GDExample",
+                          PropertyInfo(Variant::INT, "solver",
+                                       PROPERTY_HINT_ENUM, "Forces,Positions"),
+                          "set_solver", "get_solver");
+    ClassDB::bind_method(D_METHOD("get_solver_relaxation"),
+                         &GDExample::get_solver_relaxation);
+    ClassDB::bind_method(
+        D_METHOD("set_solver_relaxation", "p_solver_relaxation"),
+        &GDExample::set_solver_relaxation);
+    ClassDB::add_property("GDExample",
+                          PropertyInfo(Variant::FLOAT, "solver_relaxation",
+                                       PROPERTY_HINT_RANGE, "0.1,3,0.01"),
+                          "set_solver_relaxation", "get_solver_relaxation");
+
+    // Stage times in milliseconds and counters, empty unless the extension
+    // is built with EWDG_PROFILING
+    ClassDB::bind_method(D_METHOD("get_profile"), &GDExample::get_profile);
+    // Steps the last finished simulation took and why it ended
+    ClassDB::bind_method(D_METHOD("get_simulation_stats"),
+                         &GDExample::get_simulation_stats);
   };
 
 public:
@@ -95,42 +137,81 @@ public:
             Color c = Color(1, 0, 0, 1));
   void _ready() override;
   void _process(double delta) override;
+  void _exit_tree() override;
+
+  void set_seed(const int64_t p_seed) {
+    seed = p_seed;
+    parameters_changed();
+  }
+  int64_t get_seed() const { return seed; };
 
   void set_rooms_to_be_generated(const int p_room_to_be_generated) {
     room_to_be_generated = p_room_to_be_generated;
+    parameters_changed();
   }
   int get_rooms_to_be_generated() const { return room_to_be_generated; };
 
   void set_main_room_count(const int p_main_room_count) {
     main_room_count = p_main_room_count;
+    parameters_changed();
   }
   int get_main_room_count() const { return main_room_count; };
 
   void set_min_max_room_width(const Vector2 p_min_max_room_width) {
     min_max_room_width = p_min_max_room_width;
+    parameters_changed();
   }
   Vector2 get_min_max_room_width() const { return min_max_room_width; };
 
   void set_simulation_timestep(const double p_simulation_timestep) {
     simulation_timestep = p_simulation_timestep;
+    parameters_changed();
   }
 
   double get_simulation_timestep() const { return simulation_timestep; }
 
   void set_repultion_force(const double p_repultion_force) {
     repultion_force = p_repultion_force;
+    parameters_changed();
   }
 
   double get_repultion_force() const { return repultion_force; }
 
   void set_friction_force(const double p_friction_force) {
     friction_force = p_friction_force;
+    parameters_changed();
   }
 
   double get_friction_force() const { return friction_force; }
 
+  void set_solver(const int64_t p_solver) {
+    solver = p_solver;
+    parameters_changed();
+  }
+
+  int64_t get_solver() const { return solver; }
+
+  void set_solver_relaxation(const double p_solver_relaxation) {
+    solver_relaxation = p_solver_relaxation;
+    parameters_changed();
+  }
+
+  double get_solver_relaxation() const { return solver_relaxation; }
+
+  Dictionary get_profile() const;
+  Dictionary get_simulation_stats() const;
+
 private:
   std::vector<MeshInstance3D *> mesh_instances{};
+  ewdg::PreviewMesh preview;
+  Ref<ArrayMesh> preview_mesh;
+
+  void start_generation();
+  void parameters_changed();
+  void clear_lines();
+  void draw_layout(const ewdg::GenerationSnapshot &snapshot);
+  void update_preview_mesh(const std::vector<ewdg::Room> &rooms);
+  Ref<ArrayMesh> dungeon_surface_mesh(const ewdg::GenerationSnapshot &result);
 };
 
 } // namespace godot
@@ -0,0 +1,189 @@
+#ifndef ASYNC_GENERATOR_H_
+#define ASYNC_GENERATOR_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ewdg.h"
+#include "triple_buffer.h"
+
+namespace ewdg {
+enum GenerationStage : uint32_t {
+  // rooms holds the rooms of the running simulation
+  GENERATION_SIMULATING,
+  // main_rooms and layout hold the finished layout
+  GENERATION_LAYOUT,
+  // vertices and indices hold the main room mesh, profile and simulation
+  // the whole run. vertices are packed xyz floats, so they can be copied
+  // into an engine's vertex array as they are.
+  GENERATION_DONE
+};
+
+// Intermediate or final state of a run. Only the fields of its stage are
+// filled in.
+struct GenerationSnapshot {
+  // start() call the snapshot belongs to
+  uint64_t run = 0;
+  GenerationStage stage = GENERATION_SIMULATING;
+  std::vector<Room> rooms;
+  std::vector<Room> main_rooms;
+  Graph layout;
+  std::vector<float> vertices;
+  std::vector<int32_t> indices;
+  Profile profile;
+  SimulationStats simulation;
+};
+
+// Runs the generation pipeline of one dungeon on a background thread and
+// hands snapshots of its progress to the thread that polls it, e.g. an
+// engine's main thread. The handoff is a TripleBuffer, so the worker never
+// waits for the main thread and the main thread only ever installs the
+// newest snapshot. start and cancel never wait for the worker either, one
+// worker thread lives as long as the generator and picks up the newest run.
+class AsyncGenerator {
+public:
+  // Waits for the worker, which finishes at most one stage of a cancelled
+  // run first
+  ~AsyncGenerator() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      wanted.store(0, std::memory_order_relaxed);
+      stopping = true;
+    }
+    wake.notify_one();
+    if (worker.joinable())
+      worker.join();
+  }
+
+  // Cancels the running generation, if any, and starts a new one. Returns
+  // the id that the new run's snapshots carry.
+  uint64_t start(const DungeonParams &params) {
+    uint64_t id;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      id = ++run_id;
+      pending = params;
+      wanted.store(id, std::memory_order_relaxed);
+      if (!worker.joinable())
+        worker = std::thread([this] { work(); });
+    }
+    wake.notify_one();
+    return id;
+  }
+
+  // Stops the running generation without waiting for it. The worker checks
+  // between simulation steps and stages and drops the run at its next check.
+  void cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    wanted.store(0, std::memory_order_relaxed);
+  }
+
+  // Id of the last run started
+  uint64_t current_run() const { return run_id; }
+
+  // Newest snapshot published since the last poll, or nullptr. It stays
+  // valid until the next poll, snapshots of cancelled runs may still show
+  // up and should be checked against current_run().
+  const GenerationSnapshot *poll() {
+    return snapshots.update() ? &snapshots.front() : nullptr;
+  }
+
+private:
+  Dungeon d;
+  TripleBuffer<GenerationSnapshot> snapshots;
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable wake;
+  // Guarded by mutex
+  DungeonParams pending;
+  uint64_t run_id = 0;
+  bool stopping = false;
+  // Run the worker should be running, 0 for none. Written under mutex, read
+  // by the worker's checks without it.
+  std::atomic<uint64_t> wanted{0};
+
+  bool is_cancelled(uint64_t id) const {
+    return wanted.load(std::memory_order_relaxed) != id;
+  }
+
+  void work() {
+    uint64_t taken = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [&] {
+        uint64_t id = wanted.load(std::memory_order_relaxed);
+        return stopping || (id != 0 && id != taken);
+      });
+      if (stopping)
+        return;
+      taken = wanted.load(std::memory_order_relaxed);
+      DungeonParams params = pending;
+      lock.unlock();
+      run(params, taken);
+      lock.lock();
+    }
+  }
+
+  GenerationSnapshot &begin_snapshot(uint64_t id, GenerationStage stage) {
+    GenerationSnapshot &s = snapshots.back();
+    s.run = id;
+    s.stage = stage;
+    s.rooms.clear();
+    s.main_rooms.clear();
+    s.layout.clear();
+    s.vertices.clear();
+    s.indices.clear();
+    s.simulation = SimulationStats();
+    return s;
+  }
+
+  // Same stages as Dungeon::generate, with the simulation stepped one step
+  // at a time so it can be previewed and cancelled
+  void run(const DungeonParams &params, uint64_t id) {
+    d.reset();
+    d.apply_params(params);
+    d.generate_rooms(params.room_count, params.min_room_width,
+                     params.max_room_width);
+
+    bool done = false;
+    while (!done) {
+      if (is_cancelled(id))
+        return;
+      done = d.time_step_rooms(params.repulsion_force, params.friction_force,
+                               params.simulation_timestep);
+      begin_snapshot(id, GENERATION_SIMULATING).rooms = d.rooms;
+      snapshots.publish();
+    }
+
+    if (is_cancelled(id))
+      return;
+    d.make_graf_layout(params.main_room_count, params.extra_paths_count);
+    GenerationSnapshot &layout = begin_snapshot(id, GENERATION_LAYOUT);
+    layout.main_rooms = d.main_rooms;
+    layout.layout = d.dungeon_layout;
+    snapshots.publish();
+
+    if (is_cancelled(id))
+      return;
+    d.generate_paths();
+    GenerationSnapshot &result = begin_snapshot(id, GENERATION_DONE);
+    result.main_rooms = d.main_rooms;
+    result.layout = d.dungeon_layout;
+    // Written as floats once, the snapshot's buffers keep their capacity
+    std::pair<size_t, size_t> size = d.mesh_size(true);
+    result.vertices.resize(3 * size.first);
+    result.indices.resize(size.second);
+    BufferSink<float> sink(result.vertices.data(), size.first,
+                           result.indices.data(), size.second);
+    d.generate_mesh(sink, true);
+    result.profile = d.profile();
+    result.simulation = d.simulation_stats();
+    snapshots.publish();
+  }
+};
+} // namespace ewdg
+#endif // ASYNC_GENERATOR_H_
@@ -0,0 +1,391 @@
+#ifndef CHUNKED_WORLD_H_
+#define CHUNKED_WORLD_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "corridor_router.h"
+#include "ewdg.h"
+#include "math/graph.h"
+#include "math/vector2.h"
+#include "path.h"
+#include "room.h"
+
+namespace ewdg {
+struct TileCoord {
+  int32_t x = 0;
+  int32_t y = 0;
+
+  bool operator==(const TileCoord &other) const {
+    return x == other.x && y == other.y;
+  }
+  bool operator!=(const TileCoord &other) const { return !(*this == other); }
+  // Row major, used to keep iteration and tie breaks deterministic
+  bool operator<(const TileCoord &other) const {
+    return y != other.y ? y < other.y : x < other.x;
+  }
+};
+
+struct ChunkedWorldParams {
+  uint64_t seed = 0;
+  // Edge length of the square tiles
+  double tile_size = 160.0;
+  // Rooms keep this distance to their tile's border, rooms the separation
+  // pushes closer are discarded
+  double border_margin = 4.0;
+  // Room generation inside every tile. The seed is ignored, every tile
+  // derives its own from the world seed.
+  DungeonParams rooms;
+  // Upper bound on the number of tiles kept in memory
+  size_t max_active_tiles = 25;
+};
+
+// Generated contents of one tile, in world coordinates
+struct Tile {
+  TileCoord coord;
+  std::vector<Room> rooms;
+  std::vector<Room> main_rooms;
+  std::vector<Path> paths;
+  Graph layout;
+  uint64_t last_used = 0;
+};
+
+// Corridor between the closest main rooms of two neighbouring tiles. a is
+// the tile to the left of or above b, and its mesh holds the corridor. With
+// route_corridors it is routed around the main rooms of both tiles.
+struct TileStitch {
+  TileCoord a, b;
+  uint32_t room_a, room_b;
+  double weight;
+  Path path;
+};
+
+// Unbounded dungeon split into square tiles that are generated on demand.
+// Every tile runs the normal pipeline on its own rooms with a seed derived
+// from the world seed and its coordinate, so a tile is the same however
+// often it is evicted and regenerated. Neighbouring tiles are connected
+// through their closest main rooms. Memory is bounded by max_active_tiles,
+// not by the size of the world.
+class ChunkedWorld {
+public:
+  explicit ChunkedWorld(const ChunkedWorldParams &params = {})
+      : params(params) {}
+
+  const ChunkedWorldParams &get_params() const { return params; }
+
+  TileCoord tile_at(const Vector2 &position) const {
+    return {static_cast<int32_t>(std::floor(position.x / params.tile_size)),
+            static_cast<int32_t>(std::floor(position.y / params.tile_size))};
+  }
+
+  Vector2 tile_center(TileCoord c) const {
+    return {(c.x + 0.5) * params.tile_size, (c.y + 0.5) * params.tile_size};
+  }
+
+  uint64_t tile_seed(TileCoord c) const {
+    uint64_t h = params.seed;
+    h = mix(h ^ static_cast<uint32_t>(c.x));
+    h = mix(h ^ (uint64_t(static_cast<uint32_t>(c.y)) << 32));
+    return h;
+  }
+
+  // Generates every missing tile within radius of position, nearest first
+  // and at most max_active_tiles of them, then evicts the tiles that were
+  // needed least recently until the bound holds again. Returns the number
+  // of tiles generated.
+  size_t update(const Vector2 &position, double radius) {
+    clock++;
+    generated.clear();
+    evicted.clear();
+    dirty.clear();
+
+    wanted.clear();
+    TileCoord lo = tile_at(position - Vector2(radius, radius));
+    TileCoord hi = tile_at(position + Vector2(radius, radius));
+    for (int32_t y = lo.y; y <= hi.y; y++) {
+      for (int32_t x = lo.x; x <= hi.x; x++) {
+        double d = distance_to_tile({x, y}, position);
+        if (d <= radius)
+          wanted.push_back({d, {x, y}});
+      }
+    }
+    std::sort(wanted.begin(), wanted.end(),
+              [](const std::pair<double, TileCoord> &a,
+                 const std::pair<double, TileCoord> &b) {
+                return a.first != b.first ? a.first < b.first
+                                          : a.second < b.second;
+              });
+    if (wanted.size() > params.max_active_tiles)
+      wanted.resize(params.max_active_tiles);
+
+    for (const std::pair<double, TileCoord> &w : wanted) {
+      auto it = tiles.find(key(w.second));
+      if (it == tiles.end()) {
+        it = tiles.emplace(key(w.second), generate_tile(w.second)).first;
+        generated.push_back(w.second);
+        dirty.push_back(w.second);
+      }
+      it->second->last_used = clock;
+    }
+
+    for (TileCoord c : generated) {
+      const TileCoord neighbours[4] = {
+          {c.x - 1, c.y}, {c.x + 1, c.y}, {c.x, c.y - 1}, {c.x, c.y + 1}};
+      for (TileCoord n : neighbours) {
+        if (find_tile(n) && !has_stitch(c, n))
+          stitch(c, n);
+      }
+    }
+
+    while (tiles.size() > params.max_active_tiles) {
+      evict(least_recently_used());
+    }
+
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+    return generated.size();
+  }
+
+  const Tile *find_tile(TileCoord c) const {
+    auto it = tiles.find(key(c));
+    return it == tiles.end() ? nullptr : it->second.get();
+  }
+
+  size_t active_tile_count() const { return tiles.size(); }
+
+  // Coordinates of every active tile, row major
+  std::vector<TileCoord> active_tiles() const {
+    std::vector<TileCoord> coords;
+    coords.reserve(tiles.size());
+    for (const auto &entry : tiles) {
+      coords.push_back(entry.second->coord);
+    }
+    std::sort(coords.begin(), coords.end());
+    return coords;
+  }
+
+  const std::vector<TileStitch> &stitches() const { return stitch_list; }
+
+  // Tiles generated and evicted by the last update
+  const std::vector<TileCoord> &generated_tiles() const { return generated; }
+  const std::vector<TileCoord> &evicted_tiles() const { return evicted; }
+  // Active tiles whose mesh changed in the last update, because they were
+  // generated or a stitch to a neighbour was added or removed
+  const std::vector<TileCoord> &dirty_tiles() const { return dirty; }
+
+  // Number of vertices and indices generate_tile_mesh produces
+  std::pair<size_t, size_t> tile_mesh_size(TileCoord c) const {
+    std::pair<size_t, size_t> size(0, 0);
+    auto add = [&](std::pair<size_t, size_t> part) {
+      size.first += part.first;
+      size.second += part.second;
+    };
+    const Tile *tile = find_tile(c);
+    if (!tile)
+      return size;
+    for (const Room &r : tile->main_rooms) {
+      add(r.mesh_size());
+    }
+    for (const Path &p : tile->paths) {
+      add(p.mesh_size());
+    }
+    for (const TileStitch &s : stitch_list) {
+      if (s.a == c)
+        add(s.path.mesh_size());
+    }
+    return size;
+  }
+
+  // Main rooms, paths and outgoing stitch corridors of one tile
+  template <typename Sink> void generate_tile_mesh(TileCoord c, Sink &sink) {
+    const Tile *tile = find_tile(c);
+    if (!tile)
+      return;
+    for (const Room &r : tile->main_rooms) {
+      r.generate_3d_mesh(sink);
+    }
+    for (const Path &p : tile->paths) {
+      p.generate_3d_mesh(sink);
+    }
+    for (const TileStitch &s : stitch_list) {
+      if (s.a == c)
+        s.path.generate_3d_mesh(sink);
+    }
+  }
+
+  // Every active tile, row major
+  template <typename Sink> void generate_mesh(Sink &sink) {
+    for (TileCoord c : active_tiles()) {
+      generate_tile_mesh(c, sink);
+    }
+  }
+
+  void clear() {
+    tiles.clear();
+    stitch_list.clear();
+    generated.clear();
+    evicted.clear();
+    dirty.clear();
+  }
+
+private:
+  ChunkedWorldParams params;
+  // Generates every tile, so its scratch buffers are shared by all of them
+  Dungeon worker;
+  // Routes the stitches with route_corridors
+  CorridorRouter router;
+  std::vector<Room> stitch_rooms;
+  std::vector<Vector2> stitch_points;
+  std::unordered_map<uint64_t, std::unique_ptr<Tile>> tiles;
+  std::vector<TileStitch> stitch_list;
+  uint64_t clock = 0;
+  std::vector<std::pair<double, TileCoord>> wanted;
+  std::vector<TileCoord> generated, evicted, dirty;
+
+  static uint64_t key(TileCoord c) {
+    return (uint64_t(static_cast<uint32_t>(c.y)) << 32) |
+           static_cast<uint32_t>(c.x);
+  }
+
+  // splitmix64 finalizer
+  static uint64_t mix(uint64_t z) {
+    z += 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+  double distance_to_tile(TileCoord c, const Vector2 &p) const {
+    double min_x = c.x * params.tile_size, min_y = c.y * params.tile_size;
+    double dx = std::max({min_x - p.x, 0.0, p.x - (min_x + params.tile_size)});
+    double dy = std::max({min_y - p.y, 0.0, p.y - (min_y + params.tile_size)});
+    return std::sqrt(dx * dx + dy * dy);
+  }
+
+  std::unique_ptr<Tile> generate_tile(TileCoord c) {
+    const DungeonParams &p = params.rooms;
+    Dungeon &d = worker;
+    d.reset();
+    d.apply_params(p);
+    d.set_seed(tile_seed(c));
+    d.generate_rooms(p.room_count, p.min_room_width, p.max_room_width);
+    d.simulate_rooms(p.repulsion_force, p.friction_force,
+                     p.simulation_timestep);
+
+    // Keep the rooms that stayed inside the tile, so rooms of neighbouring
+    // tiles can never overlap
+    double limit = params.tile_size / 2 - params.border_margin;
+    auto outside = [limit](const Room &r) {
+      return std::fabs(r.position.x) + r.width / 2 > limit ||
+             std::fabs(r.position.y) + r.height / 2 > limit;
+    };
+    d.rooms.erase(std::remove_if(d.rooms.begin(), d.rooms.end(), outside),
+                  d.rooms.end());
+    Vector2 center = tile_center(c);
+    for (Room &r : d.rooms) {
+      r.position = r.position + center;
+    }
+
+    d.make_graf_layout(p.main_room_count, p.extra_paths_count);
+    d.generate_paths();
+
+    std::unique_ptr<Tile> tile = std::make_unique<Tile>();
+    tile->coord = c;
+    tile->rooms = std::move(d.rooms);
+    tile->main_rooms = std::move(d.main_rooms);
+    tile->paths = std::move(d.paths);
+    tile->layout = std::move(d.dungeon_layout);
+    d.reset();
+    return tile;
+  }
+
+  bool has_stitch(TileCoord a, TileCoord b) const {
+    for (const TileStitch &s : stitch_list) {
+      if ((s.a == a && s.b == b) || (s.a == b && s.b == a))
+        return true;
+    }
+    return false;
+  }
+
+  // Connects the closest pair of main rooms. The tiles are put in a fixed
+  // order first, so the corridor is the same whichever was generated first.
+  void stitch(TileCoord a, TileCoord b) {
+    if (b < a)
+      std::swap(a, b);
+    Tile &ta = *tiles.at(key(a));
+    Tile &tb = *tiles.at(key(b));
+    double best = std::numeric_limits<double>::infinity();
+    uint32_t best_a = 0, best_b = 0;
+    for (uint32_t i = 0; i < ta.main_rooms.size(); i++) {
+      for (uint32_t j = 0; j < tb.main_rooms.size(); j++) {
+        double d =
+            (ta.main_rooms[i].position - tb.main_rooms[j].position).length();
+        if (d < best) {
+          best = d;
+          best_a = i;
+          best_b = j;
+        }
+      }
+    }
+    if (best == std::numeric_limits<double>::infinity())
+      return;
+    Room &ra = ta.main_rooms[best_a];
+    Room &rb = tb.main_rooms[best_b];
+    // Like route_paths, falls back to a straight or L-shaped path
+    bool routed = false;
+    if (params.rooms.route_corridors) {
+      stitch_rooms.assign(ta.main_rooms.begin(), ta.main_rooms.end());
+      stitch_rooms.insert(stitch_rooms.end(), tb.main_rooms.begin(),
+                          tb.main_rooms.end());
+      router.build_grid(stitch_rooms, 2);
+      routed = router.route(ra, rb, stitch_points);
+    }
+    stitch_list.push_back(
+        {a, b, best_a, best_b, best,
+         routed ? Path(ra, rb, stitch_points) : Path(ra, rb)});
+    dirty.push_back(a);
+    dirty.push_back(b);
+  }
+
+  TileCoord least_recently_used() const {
+    const Tile *oldest = nullptr;
+    for (const auto &entry : tiles) {
+      const Tile *t = entry.second.get();
+      if (!oldest || t->last_used < oldest->last_used ||
+          (t->last_used == oldest->last_used && t->coord < oldest->coord))
+        oldest = t;
+    }
+    return oldest->coord;
+  }
+
+  // Drops the tile and its stitches, removing the stitch entrances from the
+  // neighbours that stay
+  void evict(TileCoord c) {
+    for (size_t i = 0; i < stitch_list.size();) {
+      const TileStitch &s = stitch_list[i];
+      if (s.a != c && s.b != c) {
+        i++;
+        continue;
+      }
+      bool a_stays = s.b == c;
+      TileCoord other = a_stays ? s.a : s.b;
+      Room &room = a_stays ? tiles.at(key(other))->main_rooms[s.room_a]
+                           : tiles.at(key(other))->main_rooms[s.room_b];
+      room.remove_entrance(a_stays ? s.path.start : s.path.end);
+      dirty.push_back(other);
+      stitch_list.erase(stitch_list.begin() + i);
+    }
+    tiles.erase(key(c));
+    evicted.push_back(c);
+    dirty.erase(std::remove(dirty.begin(), dirty.end(), c), dirty.end());
+  }
+};
+} // namespace ewdg
+#endif // CHUNKED_WORLD_H_
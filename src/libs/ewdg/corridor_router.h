@@ -0,0 +1,324 @@
+#ifndef CORRIDOR_ROUTER_H_
+#define CORRIDOR_ROUTER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "math/graph.h"
+#include "math/vector2.h"
+#include "path.h"
+#include "room.h"
+
+namespace ewdg {
+// Routes corridors around rooms with A* on an occupancy grid whose cells
+// are one corridor wide. Rooms block the cells they overlap, cells used by
+// earlier corridors are cheaper than free ones so corridors merge, and
+// turns cost extra so corridors stay straight. The search state is the cell
+// and the direction it was entered from.
+//
+// Every buffer is kept between calls. Per-search arrays are tagged with the
+// number of the search that last wrote them instead of being cleared.
+class CorridorRouter {
+public:
+  static constexpr uint32_t FREE_COST = 2;
+  static constexpr uint32_t CORRIDOR_COST = 1;
+  static constexpr uint32_t TURN_COST = 1;
+  // Free cells kept around the rooms' bounds so corridors can go around
+  // rooms at the edge
+  static constexpr int32_t BORDER_CELLS = 4;
+
+  // Nodes expanded by all searches since build_grid
+  size_t expanded_nodes = 0;
+
+  // Rasterizes the rooms into a fresh grid of cell_size cells
+  void build_grid(const std::vector<Room> &rooms, double cell_size) {
+    cell = cell_size;
+    double min_x = std::numeric_limits<double>::infinity();
+    double min_y = min_x, max_x = -min_x, max_y = -min_x;
+    for (const Room &r : rooms) {
+      min_x = std::min(min_x, r.position.x - r.width / 2);
+      min_y = std::min(min_y, r.position.y - r.height / 2);
+      max_x = std::max(max_x, r.position.x + r.width / 2);
+      max_y = std::max(max_y, r.position.y + r.height / 2);
+    }
+    if (rooms.empty())
+      min_x = min_y = max_x = max_y = 0;
+    origin_x = min_x - BORDER_CELLS * cell;
+    origin_y = min_y - BORDER_CELLS * cell;
+    columns = static_cast<int32_t>(std::ceil((max_x - min_x) / cell)) +
+              2 * BORDER_CELLS;
+    rows = static_cast<int32_t>(std::ceil((max_y - min_y) / cell)) +
+           2 * BORDER_CELLS;
+
+    size_t cells = size_t(columns) * rows;
+    grid.assign(cells, FREE);
+    goal_stamp.assign(cells, 0);
+    g.resize(4 * cells);
+    parent.resize(4 * cells);
+    seen_stamp.assign(4 * cells, 0);
+    closed_stamp.assign(4 * cells, 0);
+    search = 0;
+    expanded_nodes = 0;
+
+    for (const Room &r : rooms) {
+      Footprint f = footprint(r);
+      for (int32_t y = f.y0; y <= f.y1; y++) {
+        for (int32_t x = f.x0; x <= f.x1; x++) {
+          grid[index(x, y)] = BLOCKED;
+        }
+      }
+    }
+  }
+
+  // Finds a corridor from a wall of a to a wall of b and writes its corner
+  // points to points. Returns false if the rooms cannot be connected.
+  bool route(const Room &a, const Room &b, std::vector<Vector2> &points) {
+    points.clear();
+    if (++search == 0)
+      reset_stamps();
+    target = footprint(b);
+
+    // Cells where a corridor can enter b
+    for_each_ring_cell(b, [&](int32_t x, int32_t y, int) {
+      goal_stamp[index(x, y)] = search;
+    });
+
+    open.clear();
+    for_each_ring_cell(a, [&](int32_t x, int32_t y, int outward) {
+      uint32_t state = index(x, y) * 4 + outward;
+      relax(state, cost(index(x, y)), NONE, x, y);
+    });
+
+    uint32_t goal = NONE;
+    while (!open.empty()) {
+      std::pop_heap(open.begin(), open.end(), greater);
+      uint32_t state = open.back().state;
+      open.pop_back();
+      if (closed_stamp[state] == search)
+        continue;
+      closed_stamp[state] = search;
+      expanded_nodes++;
+
+      uint32_t c = state / 4;
+      int dir = state % 4;
+      if (goal_stamp[c] == search) {
+        goal = state;
+        break;
+      }
+      int32_t x = c % columns, y = c / columns;
+      for (int d = 0; d < 4; d++) {
+        int32_t nx = x + DX[d], ny = y + DY[d];
+        if (nx < 0 || ny < 0 || nx >= columns || ny >= rows)
+          continue;
+        uint32_t nc = index(nx, ny);
+        if (grid[nc] == BLOCKED)
+          continue;
+        uint32_t ng = g[state] + cost(nc) + (d != dir ? TURN_COST : 0);
+        relax(nc * 4 + d, ng, state, nx, ny);
+      }
+    }
+    if (goal == NONE)
+      return false;
+
+    cells.clear();
+    for (uint32_t s = goal; s != NONE; s = parent[s]) {
+      cells.push_back(s / 4);
+    }
+    std::reverse(cells.begin(), cells.end());
+
+    points.push_back(wall_point(a, cells.front()));
+    for (uint32_t c : cells) {
+      add_point(points, center(c));
+      if (grid[c] == FREE)
+        grid[c] = CORRIDOR;
+    }
+    add_point(points, wall_point(b, cells.back()));
+    return true;
+  }
+
+  // Routes every layout edge between rooms in order, falling back to the
+  // straight or L-shaped Path when a pair cannot be connected
+  void route_paths(std::vector<Room> &rooms, const Graph &layout,
+                   std::vector<Path> &paths, double width = 2) {
+    build_grid(rooms, width);
+    for (const GraphEdge &e : layout.edges) {
+      Room &from = rooms[e.from];
+      Room &to = rooms[e.to];
+      if (route(from, to, scratch_points)) {
+        std::vector<Vector2> points;
+        if (!spare_points.empty()) {
+          points = std::move(spare_points.back());
+          spare_points.pop_back();
+        }
+        points.assign(scratch_points.begin(), scratch_points.end());
+        paths.push_back(Path(from, to, std::move(points), width));
+      } else
+        paths.push_back(Path(from, to, width));
+    }
+  }
+
+  // Keeps the corner list of a path that is no longer needed, the next
+  // routed path reuses its capacity
+  void recycle(std::vector<Vector2> &&points) {
+    if (points.capacity() == 0)
+      return;
+    points.clear();
+    spare_points.push_back(std::move(points));
+  }
+
+private:
+  enum Cell : uint8_t { FREE, CORRIDOR, BLOCKED };
+  static constexpr uint32_t NONE = UINT32_MAX;
+  // +x, -x, +y, -y
+  static constexpr int32_t DX[4] = {1, -1, 0, 0};
+  static constexpr int32_t DY[4] = {0, 0, 1, -1};
+
+  struct Footprint {
+    int32_t x0, y0, x1, y1;
+  };
+
+  struct OpenNode {
+    uint32_t f;
+    uint32_t state;
+  };
+
+  double cell = 1;
+  double origin_x = 0, origin_y = 0;
+  int32_t columns = 0, rows = 0;
+  std::vector<uint8_t> grid;
+  std::vector<uint32_t> goal_stamp;
+  std::vector<uint32_t> g;
+  std::vector<uint32_t> parent;
+  std::vector<uint32_t> seen_stamp;
+  std::vector<uint32_t> closed_stamp;
+  std::vector<OpenNode> open;
+  std::vector<uint32_t> cells;
+  std::vector<Vector2> scratch_points;
+  std::vector<std::vector<Vector2>> spare_points;
+  uint32_t search = 0;
+  Footprint target{};
+
+  // Min-heap on f, ties broken by state so routes do not depend on the
+  // heap implementation
+  static bool greater(const OpenNode &a, const OpenNode &b) {
+    return a.f != b.f ? a.f > b.f : a.state > b.state;
+  }
+
+  uint32_t index(int32_t x, int32_t y) const {
+    return static_cast<uint32_t>(y) * columns + x;
+  }
+
+  uint32_t cost(uint32_t c) const {
+    return grid[c] == CORRIDOR ? CORRIDOR_COST : FREE_COST;
+  }
+
+  Vector2 center(uint32_t c) const {
+    return {origin_x + (c % columns + 0.5) * cell,
+            origin_y + (c / columns + 0.5) * cell};
+  }
+
+  // Cells the room overlaps
+  Footprint footprint(const Room &r) const {
+    Footprint f;
+    f.x0 = static_cast<int32_t>(
+        std::floor((r.position.x - r.width / 2 - origin_x) / cell));
+    f.y0 = static_cast<int32_t>(
+        std::floor((r.position.y - r.height / 2 - origin_y) / cell));
+    f.x1 = static_cast<int32_t>(
+               std::ceil((r.position.x + r.width / 2 - origin_x) / cell)) -
+           1;
+    f.y1 = static_cast<int32_t>(
+               std::ceil((r.position.y + r.height / 2 - origin_y) / cell)) -
+           1;
+    return f;
+  }
+
+  // Calls fn(x, y, outward direction) for every free cell next to a side of
+  // the room whose opening would fit on the wall
+  template <typename F> void for_each_ring_cell(const Room &r, F &&fn) const {
+    Footprint f = footprint(r);
+    double half = cell / 2;
+    double min_x = r.position.x - r.width / 2 + half;
+    double max_x = r.position.x + r.width / 2 - half;
+    double min_y = r.position.y - r.height / 2 + half;
+    double max_y = r.position.y + r.height / 2 - half;
+    auto visit = [&](int32_t x, int32_t y, int outward) {
+      if (x < 0 || y < 0 || x >= columns || y >= rows ||
+          grid[index(x, y)] == BLOCKED)
+        return;
+      Vector2 c = center(index(x, y));
+      bool fits = outward < 2 ? c.y >= min_y && c.y <= max_y
+                              : c.x >= min_x && c.x <= max_x;
+      if (fits)
+        fn(x, y, outward);
+    };
+    for (int32_t y = f.y0; y <= f.y1; y++) {
+      visit(f.x1 + 1, y, 0);
+      visit(f.x0 - 1, y, 1);
+    }
+    for (int32_t x = f.x0; x <= f.x1; x++) {
+      visit(x, f.y1 + 1, 2);
+      visit(x, f.y0 - 1, 3);
+    }
+  }
+
+  // Projection of a ring cell's center onto the room's wall
+  Vector2 wall_point(const Room &r, uint32_t c) const {
+    Vector2 p = center(c);
+    double half_width = r.width / 2, half_height = r.height / 2;
+    if (p.x > r.position.x + half_width)
+      return {r.position.x + half_width, p.y};
+    if (p.x < r.position.x - half_width)
+      return {r.position.x - half_width, p.y};
+    if (p.y > r.position.y + half_height)
+      return {p.x, r.position.y + half_height};
+    return {p.x, r.position.y - half_height};
+  }
+
+  // Appends p, dropping the previous point if it lies on the line from the
+  // one before it to p
+  static void add_point(std::vector<Vector2> &points, const Vector2 &p) {
+    size_t n = points.size();
+    if (n >= 2) {
+      const Vector2 &a = points[n - 2];
+      const Vector2 &b = points[n - 1];
+      if ((a.x == b.x && b.x == p.x) || (a.y == b.y && b.y == p.y)) {
+        points[n - 1] = p;
+        return;
+      }
+    }
+    points.push_back(p);
+  }
+
+  // Manhattan distance to the target's ring, in cells. Every step costs at
+  // least CORRIDOR_COST, so this never overestimates.
+  uint32_t heuristic(int32_t x, int32_t y) const {
+    int32_t dx = std::max({target.x0 - 1 - x, 0, x - (target.x1 + 1)});
+    int32_t dy = std::max({target.y0 - 1 - y, 0, y - (target.y1 + 1)});
+    return static_cast<uint32_t>(dx + dy) * CORRIDOR_COST;
+  }
+
+  void relax(uint32_t state, uint32_t cost_so_far, uint32_t from, int32_t x,
+             int32_t y) {
+    if (seen_stamp[state] == search && g[state] <= cost_so_far)
+      return;
+    seen_stamp[state] = search;
+    g[state] = cost_so_far;
+    parent[state] = from;
+    open.push_back({cost_so_far + heuristic(x, y), state});
+    std::push_heap(open.begin(), open.end(), greater);
+  }
+
+  void reset_stamps() {
+    std::fill(goal_stamp.begin(), goal_stamp.end(), 0);
+    std::fill(seen_stamp.begin(), seen_stamp.end(), 0);
+    std::fill(closed_stamp.begin(), closed_stamp.end(), 0);
+    search = 1;
+  }
+};
+} // namespace ewdg
+#endif // CORRIDOR_ROUTER_H_
@@ -0,0 +1,502 @@
+#ifndef DUNGEON_FILE_H_
+#define DUNGEON_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ewdg.h"
+#include "math/graph.h"
+#include "math/vector3.h"
+#include "path.h"
+#include "room.h"
+
+namespace ewdg {
+// Binary dungeon format. A fixed size header is followed by sections of
+// fixed size little-endian records, every section starting on a 64 byte
+// boundary. A mapped file can be used in place, DungeonView only checks the
+// header and hands out typed pointers into the mapping.
+//
+// Files are written and read in host byte order, which is little-endian on
+// every platform the extension targets. Big-endian hosts refuse both.
+
+constexpr uint32_t DUNGEON_FILE_VERSION = 2;
+constexpr size_t DUNGEON_FILE_ALIGNMENT = 64;
+
+enum DungeonSection : uint32_t {
+  SECTION_ROOMS,
+  SECTION_MAIN_ROOMS,
+  SECTION_ENTRANCES,
+  SECTION_EDGES,
+  SECTION_PATHS,
+  SECTION_WAYPOINTS,
+  SECTION_VERTICES,
+  SECTION_INDICES,
+  SECTION_COUNT
+};
+
+struct FileSection {
+  uint64_t offset;
+  uint32_t count;
+  uint32_t element_size;
+};
+
+struct FileHeader {
+  char magic[4]; // "EWDG"
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t section_count;
+  uint64_t file_size;
+  uint64_t reserved;
+  FileSection sections[SECTION_COUNT];
+};
+
+struct FileVector2 {
+  double x, y;
+};
+
+// Entrances are entrance_count records of the entrance section, starting
+// at first_entrance
+struct FileRoom {
+  double x, y;
+  double entrance_width;
+  double floor_to_ceiling;
+  float width, height;
+  uint32_t first_entrance;
+  uint32_t entrance_count;
+};
+
+// Layout edge between two main rooms, by index
+struct FileEdge {
+  uint32_t from, to;
+  double weight;
+};
+
+// Routed corridors keep their corner points in waypoint_count records of
+// the waypoint section, starting at first_waypoint
+struct FilePath {
+  FileVector2 start, end, intersection;
+  double width, floor_to_ceiling;
+  uint32_t straight;
+  uint32_t first_waypoint;
+  uint32_t waypoint_count;
+  uint32_t padding;
+};
+
+struct FileVertex {
+  float x, y, z;
+};
+
+static_assert(sizeof(FileSection) == 16, "FileSection layout changed");
+static_assert(sizeof(FileHeader) == 32 + 16 * SECTION_COUNT,
+              "FileHeader layout changed");
+static_assert(sizeof(FileRoom) == 48, "FileRoom layout changed");
+static_assert(sizeof(FileEdge) == 16, "FileEdge layout changed");
+static_assert(sizeof(FilePath) == 80, "FilePath layout changed");
+static_assert(sizeof(FileVertex) == 12, "FileVertex layout changed");
+
+inline bool host_is_little_endian() {
+  const uint16_t one = 1;
+  unsigned char first;
+  std::memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+// Read-only array inside a mapped file
+template <typename T> struct FileArray {
+  const T *first = nullptr;
+  size_t count = 0;
+
+  const T *begin() const { return first; }
+  const T *end() const { return first + count; }
+  const T *data() const { return first; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  const T &operator[](size_t i) const { return first[i]; }
+};
+
+namespace detail {
+constexpr uint32_t SECTION_ELEMENT_SIZES[SECTION_COUNT] = {
+    sizeof(FileRoom), sizeof(FileRoom), sizeof(FileVector2), sizeof(FileEdge),
+    sizeof(FilePath), sizeof(FileVector2), sizeof(FileVertex),
+    sizeof(int32_t),
+};
+
+inline uint64_t align_file_offset(uint64_t offset) {
+  return (offset + DUNGEON_FILE_ALIGNMENT - 1) & ~(DUNGEON_FILE_ALIGNMENT - 1);
+}
+
+inline void write_padding(std::ostream &out, uint64_t &offset) {
+  static const char zeros[DUNGEON_FILE_ALIGNMENT] = {};
+  uint64_t aligned = align_file_offset(offset);
+  out.write(zeros, static_cast<std::streamsize>(aligned - offset));
+  offset = aligned;
+}
+
+template <typename T>
+void write_record(std::ostream &out, uint64_t &offset, const T &record) {
+  static_assert(std::is_trivially_copyable<T>::value, "not a file record");
+  out.write(reinterpret_cast<const char *>(&record), sizeof(T));
+  offset += sizeof(T);
+}
+
+inline FileRoom file_room(const Room &r, uint32_t &entrances) {
+  FileRoom f{};
+  f.x = r.position.x;
+  f.y = r.position.y;
+  f.entrance_width = r.entrance_points.empty() ? 0 : r.entrance_width;
+  f.floor_to_ceiling = r.floor_to_ceiling;
+  f.width = r.width;
+  f.height = r.height;
+  f.first_entrance = entrances;
+  f.entrance_count = static_cast<uint32_t>(r.entrance_points.size());
+  entrances += f.entrance_count;
+  return f;
+}
+} // namespace detail
+
+// Streams a dungeon to out. vertices and indices are the optional baked
+// mesh, e.g. GeneratedDungeon's, and may be null. Returns false if the
+// stream failed or the host is big-endian.
+inline bool write_dungeon(std::ostream &out, const std::vector<Room> &rooms,
+                          const std::vector<Room> &main_rooms,
+                          const std::vector<Path> &paths, const Graph &layout,
+                          const std::vector<Vector3> *vertices = nullptr,
+                          const std::vector<int32_t> *indices = nullptr) {
+  if (!host_is_little_endian())
+    return false;
+
+  size_t entrance_count = 0;
+  for (const std::vector<Room> *list : {&rooms, &main_rooms}) {
+    for (const Room &r : *list) {
+      entrance_count += r.entrance_points.size();
+    }
+  }
+  size_t waypoint_count = 0;
+  for (const Path &p : paths) {
+    waypoint_count += p.polyline.size();
+  }
+  const size_t counts[SECTION_COUNT] = {
+      rooms.size(),
+      main_rooms.size(),
+      entrance_count,
+      layout.edges.size(),
+      paths.size(),
+      waypoint_count,
+      vertices ? vertices->size() : 0,
+      indices ? indices->size() : 0,
+  };
+
+  FileHeader header{};
+  std::memcpy(header.magic, "EWDG", 4);
+  header.version = DUNGEON_FILE_VERSION;
+  header.header_size = sizeof(FileHeader);
+  header.section_count = SECTION_COUNT;
+  uint64_t offset = detail::align_file_offset(sizeof(FileHeader));
+  for (uint32_t s = 0; s < SECTION_COUNT; s++) {
+    if (counts[s] > UINT32_MAX)
+      return false;
+    uint32_t size = detail::SECTION_ELEMENT_SIZES[s];
+    header.sections[s] = {offset, static_cast<uint32_t>(counts[s]), size};
+    offset = detail::align_file_offset(offset + counts[s] * size);
+  }
+  header.file_size = offset;
+
+  offset = 0;
+  detail::write_record(out, offset, header);
+  detail::write_padding(out, offset);
+
+  uint32_t entrances = 0;
+  for (const std::vector<Room> *list : {&rooms, &main_rooms}) {
+    for (const Room &r : *list) {
+      detail::write_record(out, offset, detail::file_room(r, entrances));
+    }
+    detail::write_padding(out, offset);
+  }
+
+  for (const std::vector<Room> *list : {&rooms, &main_rooms}) {
+    for (const Room &r : *list) {
+      for (const Vector2 &p : r.entrance_points) {
+        detail::write_record(out, offset, FileVector2{p.x, p.y});
+      }
+    }
+  }
+  detail::write_padding(out, offset);
+
+  for (const GraphEdge &e : layout.edges) {
+    detail::write_record(out, offset, FileEdge{e.from, e.to, e.weight});
+  }
+  detail::write_padding(out, offset);
+
+  uint32_t waypoints = 0;
+  for (const Path &p : paths) {
+    FilePath f{};
+    f.start = {p.start.x, p.start.y};
+    f.end = {p.end.x, p.end.y};
+    f.intersection = {p.intersektion.x, p.intersektion.y};
+    f.width = p.width;
+    f.floor_to_ceiling = p.floor_to_ceiling;
+    f.straight = p.straight_path ? 1 : 0;
+    f.first_waypoint = waypoints;
+    f.waypoint_count = static_cast<uint32_t>(p.polyline.size());
+    waypoints += f.waypoint_count;
+    detail::write_record(out, offset, f);
+  }
+  detail::write_padding(out, offset);
+
+  for (const Path &p : paths) {
+    for (const Vector2 &v : p.polyline) {
+      detail::write_record(out, offset, FileVector2{v.x, v.y});
+    }
+  }
+  detail::write_padding(out, offset);
+
+  if (vertices) {
+    for (const Vector3 &v : *vertices) {
+      detail::write_record(out, offset,
+                           FileVertex{static_cast<float>(v.x),
+                                      static_cast<float>(v.y),
+                                      static_cast<float>(v.z)});
+    }
+  }
+  detail::write_padding(out, offset);
+
+  if (indices && !indices->empty()) {
+    out.write(reinterpret_cast<const char *>(indices->data()),
+              static_cast<std::streamsize>(indices->size() * sizeof(int32_t)));
+    offset += indices->size() * sizeof(int32_t);
+  }
+  detail::write_padding(out, offset);
+
+  return out.good() && offset == header.file_size;
+}
+
+// Writes a generated dungeon, baking the main room mesh if bake_mesh is set
+inline bool write_dungeon(std::ostream &out, Dungeon &d, bool bake_mesh) {
+  if (!bake_mesh)
+    return write_dungeon(out, d.rooms, d.main_rooms, d.paths,
+                         d.dungeon_layout);
+  auto mesh = d.generate_mesh(true);
+  return write_dungeon(out, d.rooms, d.main_rooms, d.paths, d.dungeon_layout,
+                       &mesh.first, &mesh.second);
+}
+
+// Zero-copy view of a dungeon file in memory. open only validates the
+// header and section table, the records are used where they are.
+class DungeonView {
+public:
+  // data must stay valid while the view is used and be 8 byte aligned,
+  // which mapped files always are
+  bool open(const void *data, size_t size) {
+    header_ptr = nullptr;
+    base = static_cast<const unsigned char *>(data);
+    if (!host_is_little_endian() || !base || size < sizeof(FileHeader) ||
+        reinterpret_cast<uintptr_t>(base) % alignof(double) != 0)
+      return false;
+
+    const FileHeader *h = reinterpret_cast<const FileHeader *>(base);
+    if (std::memcmp(h->magic, "EWDG", 4) != 0 ||
+        h->version != DUNGEON_FILE_VERSION ||
+        h->header_size != sizeof(FileHeader) ||
+        h->section_count != SECTION_COUNT || h->file_size > size)
+      return false;
+
+    for (uint32_t s = 0; s < SECTION_COUNT; s++) {
+      const FileSection &section = h->sections[s];
+      if (section.element_size != detail::SECTION_ELEMENT_SIZES[s] ||
+          section.offset % DUNGEON_FILE_ALIGNMENT != 0 ||
+          section.offset > h->file_size ||
+          uint64_t(section.count) * section.element_size >
+              h->file_size - section.offset)
+        return false;
+    }
+    header_ptr = h;
+    return true;
+  }
+
+  bool is_open() const { return header_ptr != nullptr; }
+  const FileHeader &header() const { return *header_ptr; }
+
+  FileArray<FileRoom> rooms() const {
+    return section<FileRoom>(SECTION_ROOMS);
+  }
+  FileArray<FileRoom> main_rooms() const {
+    return section<FileRoom>(SECTION_MAIN_ROOMS);
+  }
+  FileArray<FileVector2> entrances() const {
+    return section<FileVector2>(SECTION_ENTRANCES);
+  }
+  // Layout edges between main_rooms, sorted like Graph::edges
+  FileArray<FileEdge> edges() const {
+    return section<FileEdge>(SECTION_EDGES);
+  }
+  FileArray<FilePath> paths() const {
+    return section<FilePath>(SECTION_PATHS);
+  }
+  FileArray<FileVector2> waypoints() const {
+    return section<FileVector2>(SECTION_WAYPOINTS);
+  }
+  FileArray<FileVertex> vertices() const {
+    return section<FileVertex>(SECTION_VERTICES);
+  }
+  FileArray<int32_t> indices() const {
+    return section<int32_t>(SECTION_INDICES);
+  }
+  bool has_mesh() const { return !vertices().empty(); }
+
+  // Empty if the room's range lies outside the entrance section
+  FileArray<FileVector2> entrances(const FileRoom &room) const {
+    FileArray<FileVector2> all = entrances();
+    if (uint64_t(room.first_entrance) + room.entrance_count > all.size())
+      return {};
+    return {all.data() + room.first_entrance, room.entrance_count};
+  }
+
+  // Corner points of a routed corridor, empty for the other paths or if
+  // the path's range lies outside the waypoint section
+  FileArray<FileVector2> waypoints(const FilePath &path) const {
+    FileArray<FileVector2> all = waypoints();
+    if (uint64_t(path.first_waypoint) + path.waypoint_count > all.size())
+      return {};
+    return {all.data() + path.first_waypoint, path.waypoint_count};
+  }
+
+private:
+  const unsigned char *base = nullptr;
+  const FileHeader *header_ptr = nullptr;
+
+  template <typename T> FileArray<T> section(DungeonSection s) const {
+    if (!header_ptr)
+      return {};
+    const FileSection &section = header_ptr->sections[s];
+    return {reinterpret_cast<const T *>(base + section.offset),
+            section.count};
+  }
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept
+      : mapped(other.mapped), length(other.length) {
+    other.mapped = nullptr;
+    other.length = 0;
+  }
+  MappedFile &operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+      close();
+      std::swap(mapped, other.mapped);
+      std::swap(length, other.length);
+    }
+    return *this;
+  }
+
+  bool open(const char *path) {
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+      CloseHandle(file);
+      return false;
+    }
+    HANDLE mapping =
+        CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping)
+      return false;
+    // The view keeps the mapping alive after its handle is closed
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view)
+      return false;
+    mapped = view;
+    length = static_cast<size_t>(file_size.QuadPart);
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+    void *view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+                      MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+      return false;
+    mapped = view;
+    length = static_cast<size_t>(info.st_size);
+#endif
+    return true;
+  }
+
+  void close() {
+    if (!mapped)
+      return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapped);
+#else
+    munmap(const_cast<void *>(mapped), length);
+#endif
+    mapped = nullptr;
+    length = 0;
+  }
+
+  const void *data() const { return mapped; }
+  size_t size() const { return length; }
+
+private:
+  const void *mapped = nullptr;
+  size_t length = 0;
+};
+
+// A mapped dungeon file and its view
+class DungeonFile {
+public:
+  bool open(const char *path) {
+    if (!file.open(path))
+      return false;
+    if (!dungeon.open(file.data(), file.size())) {
+      file.close();
+      return false;
+    }
+    return true;
+  }
+
+  const DungeonView &view() const { return dungeon; }
+
+private:
+  MappedFile file;
+  DungeonView dungeon;
+};
+} // namespace ewdg
+#endif // DUNGEON_FILE_H_
@@ -0,0 +1,171 @@
+#ifndef GENERATION_SERVICE_H_
+#define GENERATION_SERVICE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "ewdg.h"
+#include "thread_pool.h"
+
+namespace ewdg {
+// Self-contained result of one generation run. The layout refers to
+// main_rooms by index so the result can be moved and copied freely.
+struct GeneratedDungeon {
+  DungeonParams params;
+  std::vector<Room> rooms;
+  std::vector<Room> main_rooms;
+  std::vector<Path> paths;
+  Graph layout;
+  std::vector<Vector3> vertices;
+  std::vector<int32_t> indices;
+  // Stage times and counters of the run, see Profiler
+  Profile profile;
+};
+
+// Generates batches of independent dungeons on a work-stealing thread pool.
+// Every worker keeps its own Dungeon between jobs so the internal scratch
+// buffers are reused instead of reallocated for every dungeon. Results are
+// copied out of it, so a GeneratedDungeon that is filled again keeps the
+// capacity of its buffers too.
+class GenerationService {
+public:
+  using Callback = std::function<void(size_t, GeneratedDungeon &&)>;
+
+  explicit GenerationService(size_t thread_count = 0) : pool(thread_count) {
+    for (size_t i = 0; i < pool.size(); i++) {
+      scratch.push_back(std::make_unique<Dungeon>());
+    }
+    worker_results.resize(pool.size());
+  }
+
+  size_t thread_count() const { return pool.size(); }
+
+  std::future<GeneratedDungeon> generate(const DungeonParams &params) {
+    return pool.submit([this, params] {
+      GeneratedDungeon result;
+      run(params, result);
+      return result;
+    });
+  }
+
+  // Fills result, which has to stay alive until the returned future is
+  // ready. Reusing the same result avoids reallocating its buffers.
+  std::future<void> generate(const DungeonParams &params,
+                             GeneratedDungeon &result) {
+    return pool.submit([this, params, &result] { run(params, result); });
+  }
+
+  std::vector<std::future<GeneratedDungeon>>
+  generate(const std::vector<DungeonParams> &batch) {
+    std::vector<std::future<GeneratedDungeon>> results;
+    results.reserve(batch.size());
+    for (const DungeonParams &params : batch) {
+      results.push_back(generate(params));
+    }
+    return results;
+  }
+
+  // Fills results[i] with the dungeon of batch[i], results is resized to
+  // the batch. Results kept from an earlier batch keep their capacity. The
+  // returned future completes once the whole batch is done, or holds the
+  // first exception a dungeon threw.
+  std::future<void> generate(const std::vector<DungeonParams> &batch,
+                             std::vector<GeneratedDungeon> &results) {
+    results.resize(batch.size());
+    return for_each(batch, [this, &results](size_t i,
+                                            const DungeonParams &params) {
+      run(params, results[i]);
+    });
+  }
+
+  // Calls on_done(batch index, result) from the worker thread as soon as each
+  // dungeon is ready. result is the worker's own, if on_done leaves it in
+  // place its buffers are reused for the worker's next dungeon. The returned
+  // future completes once the whole batch is done, or holds the first
+  // exception a dungeon or on_done threw.
+  std::future<void> generate(const std::vector<DungeonParams> &batch,
+                             Callback on_done) {
+    return for_each(batch, [this, on_done = std::move(on_done)](
+                               size_t i, const DungeonParams &params) {
+      GeneratedDungeon &result = worker_results[pool.worker_index()];
+      run(params, result);
+      on_done(i, std::move(result));
+    });
+  }
+
+private:
+  std::vector<std::unique_ptr<Dungeon>> scratch;
+  // Per worker results of the callback batches
+  std::vector<GeneratedDungeon> worker_results;
+  // Last, so the workers are joined before the state they use is destroyed
+  ThreadPool pool;
+
+  // Runs job(i, batch[i]) on the pool for every dungeon of the batch
+  template <typename Job>
+  std::future<void> for_each(const std::vector<DungeonParams> &batch,
+                             Job job) {
+    struct Batch {
+      std::atomic<size_t> remaining;
+      std::promise<void> done;
+      std::mutex error_mutex;
+      std::exception_ptr error;
+      Job job;
+      explicit Batch(Job &&j) : job(std::move(j)) {}
+    };
+    auto state = std::make_shared<Batch>(std::move(job));
+    state->remaining = batch.size();
+    std::future<void> done = state->done.get_future();
+    if (batch.empty()) {
+      state->done.set_value();
+      return done;
+    }
+    for (size_t i = 0; i < batch.size(); i++) {
+      pool.execute([state, i, params = batch[i]] {
+        try {
+          state->job(i, params);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(state->error_mutex);
+          if (!state->error)
+            state->error = std::current_exception();
+        }
+        if (state->remaining.fetch_sub(1) == 1) {
+          if (state->error)
+            state->done.set_exception(state->error);
+          else
+            state->done.set_value();
+        }
+      });
+    }
+    return done;
+  }
+
+  // Generates into the worker's Dungeon and copies the dungeon out, which
+  // reuses the capacity of result's buffers
+  void run(const DungeonParams &params, GeneratedDungeon &result) {
+    Dungeon &d = *scratch[pool.worker_index()];
+    d.generate(params);
+
+    result.params = params;
+    std::pair<size_t, size_t> size = d.mesh_size(true);
+    result.vertices.clear();
+    result.indices.clear();
+    result.vertices.reserve(size.first);
+    result.indices.reserve(size.second);
+    VectorSink sink(result.vertices, result.indices);
+    d.generate_mesh(sink, true);
+    result.layout = d.dungeon_layout;
+    result.rooms = d.rooms;
+    result.main_rooms = d.main_rooms;
+    result.paths = d.paths;
+    result.profile = d.profile();
+  }
+};
+} // namespace ewdg
+#endif // GENERATION_SERVICE_H_
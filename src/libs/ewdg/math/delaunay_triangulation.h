@@ -1,245 +1,462 @@
 #ifndef DELAUNAY_TRIANGULATION_H_
 #define DELAUNAY_TRIANGULATION_H_
 
+#include "math/graph.h"
+#include "math/minimum_spanning_tree.h"
 #include "math/vector2.h"
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <limits>
-#include <set>
-#include <unordered_map>
 #include <vector>
 
 namespace ewdg {
 constexpr double eps = 1e-4;
 
-// TODO: Ectract to seperat file
-template <typename T> struct DisjointSet {
-  std::unordered_map<const T *, const T *> parent;
+template <typename T> class DelaunayTriangulation {
+public:
+  DelaunayTriangulation<T>() : graph() {}
 
-  void make_set(const T *v) { parent[v] = v; }
+  // Edges between indices into the triangulated vertices
+  Graph graph;
 
-  const T *find_set(const T *v) {
-    if (v == parent[v]) {
-      return v;
-    }
-    return find_set(parent[v]);
+  void brutforce_graf(const std::vector<T> &vertices) {
+    bruteforceDelaunayEdges(vertices);
   }
 
-  void union_sets(const T *a, const T *b) {
-    a = find_set(a);
-    b = find_set(b);
-    if (a != b) {
-      parent[b] = a;
+  // Sweep-hull triangulation (Sinclair's s-hull, as popularised by
+  // delaunator). Points are inserted in order of distance from a seed
+  // triangle and located on the convex hull through an angular hash, then
+  // made Delaunay by edge flips. Expected O(n log n).
+  void generate_graf(const std::vector<T> &vertices) {
+    size_t n = vertices.size();
+    graph.reset(static_cast<uint32_t>(n));
+    if (n < 2)
+      return;
+
+    triangulate(vertices);
+
+    if (triangles.empty()) {
+      // All points are collinear, connect them in order along the line.
+      for (size_t k = 1; k < ids.size(); k++) {
+        add_edge(vertices, ids[k - 1], ids[k]);
+      }
+      graph.finalize();
+      return;
     }
-  }
-};
 
-template <typename T> struct Triangle {
-  const T *t1;
-  const T *t2;
-  const T *t3;
-  struct Circumcircle {
-    Vector2 c;
-    double r;
-  };
-  Circumcircle circumCirc;
-  Triangle() : t1(nullptr), t2(nullptr), t3(nullptr) {}
-  Triangle(const T *a, const T *b, const T *c) : t1(a), t2(b), t3(c) {
-    findCircumCenter(t1->position, t2->position, t3->position);
+    for (size_t e = 0; e < triangles.size(); e++) {
+      if (halfedges[e] == INVALID || halfedges[e] < e) {
+        add_edge(vertices, triangles[e], triangles[next_halfedge(e)]);
+      }
+    }
+    graph.finalize();
   }
 
-  bool inCircumcircle(Vector2 v) const {
-    double dx = circumCirc.c.x - v.x;
-    double dy = circumCirc.c.y - v.y;
-    return ((dx * dx + dy * dy) - circumCirc.r) <= eps;
+  Graph generate_minimum_spanning_tree(ThreadPool *pool = nullptr) {
+    Graph minimum_spanning_tree;
+    generate_minimum_spanning_tree(minimum_spanning_tree, pool);
+    return minimum_spanning_tree;
   }
 
-  void findCircumCenter(Vector2 p0, Vector2 p1, Vector2 p2) {
-    const auto ax = p1.x - p0.x;
-    const auto ay = p1.y - p0.y;
-    const auto bx = p2.x - p0.x;
-    const auto by = p2.y - p0.y;
-
-    const auto m = p1.x * p1.x - p0.x * p0.x + p1.y * p1.y - p0.y * p0.y;
-    const auto u = p2.x * p2.x - p0.x * p0.x + p2.y * p2.y - p0.y * p0.y;
-    const auto s = 1. / (2. * (ax * by - ay * bx));
-
-    circumCirc.c = {((p2.y - p0.y) * m + (p0.y - p1.y) * u) * s,
-                    ((p0.x - p2.x) * m + (p1.x - p0.x) * u) * s};
-    const auto dx = p0.x - circumCirc.c.x;
-    const auto dy = p0.y - circumCirc.c.y;
-    circumCirc.r = dx * dx + dy * dy;
+  // Reuses the tree's storage. With a pool, large graphs are built in
+  // parallel, the tree is the same either way.
+  void generate_minimum_spanning_tree(Graph &tree,
+                                      ThreadPool *pool = nullptr) {
+    mst.build(graph, tree, pool);
   }
 
-  bool operator==(const Triangle<T> &other) const {
-    return t1->position == other.t1->position &&
-           t2->position == other.t2->position &&
-           t3->position == other.t3->position;
-  }
-  bool operator<=(const Triangle<T> &other) const {
-    return t1->position == other.t1->position ||
-           t1->position == other.t2->position ||
-           t1->position == other.t3->position ||
-           t2->position == other.t1->position ||
-           t2->position == other.t2->position ||
-           t2->position == other.t3->position ||
-           t3->position == other.t1->position ||
-           t3->position == other.t2->position ||
-           t3->position == other.t3->position;
+private:
+  static constexpr size_t INVALID = std::numeric_limits<size_t>::max();
+
+  MinimumSpanningTree mst;
+
+  // Triangulation scratch, kept between calls to avoid reallocating.
+  std::vector<double> coords;
+  std::vector<size_t> ids;
+  std::vector<double> dists;
+  std::vector<size_t> triangles;
+  std::vector<size_t> halfedges;
+  std::vector<size_t> hull_prev;
+  std::vector<size_t> hull_next;
+  std::vector<size_t> hull_tri;
+  std::vector<size_t> hull_hash;
+  std::vector<size_t> edge_stack;
+  size_t hull_start = 0;
+  double center_x = 0, center_y = 0;
+
+  void add_edge(const std::vector<T> &vertices, size_t a, size_t b) {
+    graph.add_edge(static_cast<uint32_t>(a), static_cast<uint32_t>(b),
+                   distance(vertices[a], vertices[b]));
   }
-  bool operator<=(const Vector2 &other) const {
-    return t1->position == other || t2->position == other ||
-           t3->position == other;
+
+  static size_t next_halfedge(size_t e) { return e % 3 == 2 ? e - 2 : e + 1; }
+
+  static double dist_sq(double ax, double ay, double bx, double by) {
+    double dx = ax - bx;
+    double dy = ay - by;
+    return dx * dx + dy * dy;
   }
-};
 
-template <typename T> struct Edge {
-  T *from;
-  T *to;
-  double weight;
+  // True if r is to the right of the line p -> q
+  static bool orient(double px, double py, double qx, double qy, double rx,
+                     double ry) {
+    return (qy - py) * (rx - qx) - (qx - px) * (ry - qy) < 0.0;
+  }
 
-  Edge(T *f, T *t, double w) : from(f), to(t), weight(w) {}
+  static double circumradius(double ax, double ay, double bx, double by,
+                             double cx, double cy) {
+    double dx = bx - ax;
+    double dy = by - ay;
+    double ex = cx - ax;
+    double ey = cy - ay;
+    double bl = dx * dx + dy * dy;
+    double cl = ex * ex + ey * ey;
+    double d = dx * ey - dy * ex;
+    if (bl <= 0 || cl <= 0 || d == 0)
+      return std::numeric_limits<double>::infinity();
+    double x = (ey * bl - dy * cl) * 0.5 / d;
+    double y = (dx * cl - ex * bl) * 0.5 / d;
+    return x * x + y * y;
+  }
 
-  bool operator<(const Edge &other) const { return weight < other.weight; }
+  static Vector2 circumcenter(double ax, double ay, double bx, double by,
+                              double cx, double cy) {
+    double dx = bx - ax;
+    double dy = by - ay;
+    double ex = cx - ax;
+    double ey = cy - ay;
+    double bl = dx * dx + dy * dy;
+    double cl = ex * ex + ey * ey;
+    double d = dx * ey - dy * ex;
+    return {ax + (ey * bl - dy * cl) * 0.5 / d,
+            ay + (dx * cl - ex * bl) * 0.5 / d};
+  }
 
-  bool operator==(const Edge &other) const {
-    return (from->position == other.from->position &&
-            to->position == other.to->position) ||
-           (to->position == other.from->position &&
-            from->position == other.to->position);
+  // True if p lies strictly inside the circumcircle of a, b, c
+  static bool in_circumcircle(double ax, double ay, double bx, double by,
+                              double cx, double cy, double px, double py) {
+    double dx = ax - px;
+    double dy = ay - py;
+    double ex = bx - px;
+    double ey = by - py;
+    double fx = cx - px;
+    double fy = cy - py;
+    double ap = dx * dx + dy * dy;
+    double bp = ex * ex + ey * ey;
+    double cp = fx * fx + fy * fy;
+    return dx * (ey * cp - bp * fy) - dy * (ex * cp - bp * fx) +
+               ap * (ex * fy - ey * fx) <
+           0;
   }
-};
 
-template <typename T> class DelaunayTriangulation {
-public:
-  DelaunayTriangulation<T>() : triangles(), edges(), superTriangle() {}
+  size_t hash_key(double x, double y) const {
+    // Monotonic pseudo-angle around the seed circumcenter
+    double dx = x - center_x;
+    double dy = y - center_y;
+    double p = dx / (std::fabs(dx) + std::fabs(dy));
+    double angle = (dy > 0.0 ? 3.0 - p : 1.0 + p) / 4.0;
+    size_t size = hull_hash.size();
+    return static_cast<size_t>(std::floor(angle * size)) % size;
+  }
 
-  std::set<Edge<T>> edges;
+  void link(size_t a, size_t b) {
+    halfedges[a] = b;
+    if (b != INVALID)
+      halfedges[b] = a;
+  }
 
-  void brutforce_graf(std::vector<T> &vertices) {
-    bruteforceDelaunayEdges(vertices);
+  size_t add_triangle(size_t i0, size_t i1, size_t i2, size_t a, size_t b,
+                      size_t c) {
+    size_t t = triangles.size();
+    triangles.push_back(i0);
+    triangles.push_back(i1);
+    triangles.push_back(i2);
+    halfedges.resize(t + 3);
+    link(t, a);
+    link(t + 1, b);
+    link(t + 2, c);
+    return t;
   }
 
-  // FIXME: Dose not produce expected results
-  void generate_graf(const std::vector<T> &vertices) {
-    if (vertices.size() < 3)
-      return;
+  // Flips edges until the triangles around halfedge a are Delaunay again.
+  size_t legalize(size_t a) {
+    size_t ar = 0;
+    edge_stack.clear();
+    while (true) {
+      size_t b = halfedges[a];
+      size_t a0 = a - a % 3;
+      ar = a0 + (a + 2) % 3;
+
+      if (b == INVALID) {
+        if (edge_stack.empty())
+          break;
+        a = edge_stack.back();
+        edge_stack.pop_back();
+        continue;
+      }
 
-    // Initialize the triangulation with a super-triangle
-    initialize_super_triangle(vertices);
+      size_t b0 = b - b % 3;
+      size_t al = a0 + (a + 1) % 3;
+      size_t bl = b0 + (b + 2) % 3;
 
-    for (const auto &v : vertices) {
-      insertVertex(v);
-    }
+      size_t p0 = triangles[ar];
+      size_t pr = triangles[a];
+      size_t pl = triangles[al];
+      size_t p1 = triangles[bl];
 
-    triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
-                                   [&](const Triangle<T> &triangle) {
-                                     return triangle <= superTriangle;
-                                   }),
-                    triangles.end());
-
-    for (const auto &triangle : triangles) {
-      edges.emplace(triangle.t1, triangle.t2,
-                    distance(triangle.t1, triangle.t2));
-      edges.emplace(triangle.t2, triangle.t3,
-                    distance(triangle.t2, triangle.t3));
-      edges.emplace(triangle.t3, triangle.t1,
-                    distance(triangle.t3, triangle.t1));
-    }
-  }
+      bool illegal = in_circumcircle(
+          coords[2 * p0], coords[2 * p0 + 1], coords[2 * pr],
+          coords[2 * pr + 1], coords[2 * pl], coords[2 * pl + 1],
+          coords[2 * p1], coords[2 * p1 + 1]);
 
-  std::set<Edge<T>> generate_minimum_spanning_tree() {
-    std::set<Edge<T>> minimum_spanning_tree;
-    DisjointSet<T> ds;
+      if (illegal) {
+        triangles[a] = p1;
+        triangles[b] = p0;
 
-    // Sort the edges based on their weights
-    std::vector<Edge<T>> sorted_edges(edges.begin(), edges.end());
-    std::sort(
-        sorted_edges.begin(), sorted_edges.end(),
-        [](const Edge<T> &a, const Edge<T> &b) { return a.weight < b.weight; });
+        size_t hbl = halfedges[bl];
 
-    for (const auto &edge : edges) {
-      ds.make_set(edge.from);
-      ds.make_set(edge.to);
-    }
+        // The flipped edge is on the hull, fix the halfedge reference
+        if (hbl == INVALID) {
+          size_t e = hull_start;
+          do {
+            if (hull_tri[e] == bl) {
+              hull_tri[e] = a;
+              break;
+            }
+            e = hull_prev[e];
+          } while (e != hull_start);
+        }
+        link(a, hbl);
+        link(b, halfedges[ar]);
+        link(ar, bl);
 
-    for (const auto &edge : sorted_edges) {
-      const T *root_from = ds.find_set(edge.from);
-      const T *root_to = ds.find_set(edge.to);
-      if (root_from != root_to) {
-        minimum_spanning_tree.insert(edge); // Insert directly into set
-        ds.union_sets(edge.from, edge.to);
+        edge_stack.push_back(b0 + (b + 1) % 3);
+      } else {
+        if (edge_stack.empty())
+          break;
+        a = edge_stack.back();
+        edge_stack.pop_back();
       }
     }
-    return minimum_spanning_tree;
+    return ar;
   }
 
-private:
-  Triangle<T> superTriangle;
-  T t1{}, t2{}, t3{};
-  std::vector<Triangle<T>> triangles;
-  void initialize_super_triangle(const std::vector<T> &vecT) {
+  void triangulate(const std::vector<T> &vertices) {
+    size_t n = vertices.size();
+    coords.resize(2 * n);
+    ids.resize(n);
+    triangles.clear();
+    halfedges.clear();
+
     double minx = std::numeric_limits<double>::infinity();
     double miny = std::numeric_limits<double>::infinity();
     double maxx = -std::numeric_limits<double>::infinity();
     double maxy = -std::numeric_limits<double>::infinity();
-
-    for (const auto &t : vecT) {
-      const auto vertex = t.position;
-      minx = std::min(minx, vertex.x);
-      miny = std::min(miny, vertex.y);
-      maxx = std::max(maxx, vertex.x);
-      maxy = std::max(maxy, vertex.y);
+    for (size_t i = 0; i < n; i++) {
+      double x = vertices[i].position.x;
+      double y = vertices[i].position.y;
+      coords[2 * i] = x;
+      coords[2 * i + 1] = y;
+      minx = std::min(minx, x);
+      miny = std::min(miny, y);
+      maxx = std::max(maxx, x);
+      maxy = std::max(maxy, y);
+      ids[i] = i;
+    }
+    double cx = (minx + maxx) / 2;
+    double cy = (miny + maxy) / 2;
+
+    // Seed triangle: the point closest to the center, its nearest neighbour
+    // and the point making the smallest circumcircle with them.
+    size_t i0 = INVALID, i1 = INVALID, i2 = INVALID;
+    double min_dist = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < n; i++) {
+      double d = dist_sq(cx, cy, coords[2 * i], coords[2 * i + 1]);
+      if (d < min_dist) {
+        i0 = i;
+        min_dist = d;
+      }
+    }
+    double i0x = coords[2 * i0];
+    double i0y = coords[2 * i0 + 1];
+
+    min_dist = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < n; i++) {
+      if (i == i0)
+        continue;
+      double d = dist_sq(i0x, i0y, coords[2 * i], coords[2 * i + 1]);
+      if (d < min_dist && d > 0.0) {
+        i1 = i;
+        min_dist = d;
+      }
+    }
+    if (i1 == INVALID) {
+      ids.clear(); // Every point is a duplicate of i0
+      return;
+    }
+    double i1x = coords[2 * i1];
+    double i1y = coords[2 * i1 + 1];
+
+    double min_radius = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < n; i++) {
+      if (i == i0 || i == i1)
+        continue;
+      double r = circumradius(i0x, i0y, i1x, i1y, coords[2 * i],
+                              coords[2 * i + 1]);
+      if (r < min_radius) {
+        i2 = i;
+        min_radius = r;
+      }
     }
 
-    double dx = (maxx - minx) * 10;
-    double dy = (maxy - miny) * 10;
-
-    Vector2 v1(minx - dx, miny - dy * 3);
-    Vector2 v2(minx - dx, maxy + dy);
-    Vector2 v3(maxx + dx * 3, maxy + dy);
-
-    t1.position = v1;
-    t2.position = v2;
-    t3.position = v3;
-    superTriangle = Triangle<T>(&t1, &t2, &t3);
-    std::printf("Super1: %s\n", superTriangle.t1->position.toString());
-    std::printf("Super2: %s\n", superTriangle.t2->position.toString());
-    std::printf("Super3: %s\n", superTriangle.t3->position.toString());
-    triangles.insert(superTriangle);
-    // triangles.emplace(&t1, &t2, &t3);
-  }
-
-  // TODO: FIXME Edges are crossing eachother dont know why... (BowyerWatson
-  // meathod)
-  void insertVertex(const T &t) {
-    Vector2 pt = t.position;
-    std::printf("Inserting vertex: %s\n", t.position.toString());
-    std::vector<Edge<T>> tmp_edges;
-    std::vector<Triangle<T>> new_triangles;
-
-    for (auto const &triangle : triangles) {
-      /* Check if the point is inside the triangle circumcircle. */
-      if (triangle.inCircumcircle(pt)) {
-        tmp_edges.emplace(triangle.t1, triangle.t2,
-                          distance(triangle.t1, triangle.t2));
-        tmp_edges.emplace(triangle.t2, triangle.t3,
-                          distance(triangle.t2, triangle.t3));
-        tmp_edges.emplace(triangle.t3, triangle.t1,
-                          distance(triangle.t3, triangle.t1));
-      } else {
-        new_triangles.insert(triangle);
+    if (i2 == INVALID) {
+      // Collinear input, order the points along the line instead
+      double dx = i1x - i0x;
+      double dy = i1y - i0y;
+      dists.resize(n);
+      for (size_t i = 0; i < n; i++) {
+        dists[i] = (coords[2 * i] - i0x) * dx + (coords[2 * i + 1] - i0y) * dy;
       }
+      std::sort(ids.begin(), ids.end(), [&](size_t a, size_t b) {
+        return dists[a] != dists[b] ? dists[a] < dists[b] : a < b;
+      });
+      ids.erase(std::unique(ids.begin(), ids.end(),
+                            [&](size_t a, size_t b) {
+                              return dists[a] == dists[b];
+                            }),
+                ids.end());
+      return;
     }
+    double i2x = coords[2 * i2];
+    double i2y = coords[2 * i2 + 1];
 
-    removeDuplicates(tmp_edges);
+    if (orient(i0x, i0y, i1x, i1y, i2x, i2y)) {
+      std::swap(i1, i2);
+      std::swap(i1x, i2x);
+      std::swap(i1y, i2y);
+    }
+
+    Vector2 center = circumcenter(i0x, i0y, i1x, i1y, i2x, i2y);
+    center_x = center.x;
+    center_y = center.y;
 
-    for (auto const &e : tmp_edges) {
-      new_triangles.emplace(e.from, e.to, &t);
+    // Sweep the points in order of distance from the seed circumcenter
+    dists.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      dists[i] = dist_sq(coords[2 * i], coords[2 * i + 1], center_x, center_y);
     }
+    std::sort(ids.begin(), ids.end(), [&](size_t a, size_t b) {
+      return dists[a] != dists[b] ? dists[a] < dists[b] : a < b;
+    });
+
+    size_t hash_size =
+        static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(n))));
+    hull_hash.assign(hash_size, INVALID);
+    hull_prev.assign(n, 0);
+    hull_next.assign(n, 0);
+    hull_tri.assign(n, 0);
+
+    hull_start = i0;
+    hull_next[i0] = hull_prev[i2] = i1;
+    hull_next[i1] = hull_prev[i0] = i2;
+    hull_next[i2] = hull_prev[i1] = i0;
+
+    hull_tri[i0] = 0;
+    hull_tri[i1] = 1;
+    hull_tri[i2] = 2;
+
+    hull_hash[hash_key(i0x, i0y)] = i0;
+    hull_hash[hash_key(i1x, i1y)] = i1;
+    hull_hash[hash_key(i2x, i2y)] = i2;
+
+    size_t max_triangles = n < 3 ? 1 : 2 * n - 5;
+    triangles.reserve(max_triangles * 3);
+    halfedges.reserve(max_triangles * 3);
+    add_triangle(i0, i1, i2, INVALID, INVALID, INVALID);
+
+    double xp = std::numeric_limits<double>::quiet_NaN();
+    double yp = std::numeric_limits<double>::quiet_NaN();
+    for (size_t k = 0; k < n; k++) {
+      size_t i = ids[k];
+      double x = coords[2 * i];
+      double y = coords[2 * i + 1];
+
+      // Skip near-duplicate points
+      if (k > 0 && std::fabs(x - xp) <= eps && std::fabs(y - yp) <= eps)
+        continue;
+      xp = x;
+      yp = y;
+
+      // Skip seed triangle points
+      if (i == i0 || i == i1 || i == i2)
+        continue;
+
+      // Find a visible edge on the convex hull using the edge hash
+      size_t start = 0;
+      size_t key = hash_key(x, y);
+      for (size_t j = 0; j < hash_size; j++) {
+        start = hull_hash[(key + j) % hash_size];
+        if (start != INVALID && start != hull_next[start])
+          break;
+      }
+
+      start = hull_prev[start];
+      size_t e = start;
+      size_t q;
+      while (q = hull_next[e], !orient(x, y, coords[2 * e], coords[2 * e + 1],
+                                       coords[2 * q], coords[2 * q + 1])) {
+        e = q;
+        if (e == start) {
+          e = INVALID;
+          break;
+        }
+      }
+
+      if (e == INVALID)
+        continue; // Likely a near-duplicate point, skip it
+
+      // Add the first triangle from the point
+      size_t t =
+          add_triangle(e, i, hull_next[e], INVALID, INVALID, hull_tri[e]);
+
+      // Recursively flip triangles from the point until they satisfy the
+      // Delaunay condition
+      hull_tri[i] = legalize(t + 2);
+      hull_tri[e] = t;
+
+      // Walk forward through the hull, adding more triangles and flipping
+      size_t next = hull_next[e];
+      while (q = hull_next[next],
+             orient(x, y, coords[2 * next], coords[2 * next + 1],
+                    coords[2 * q], coords[2 * q + 1])) {
+        t = add_triangle(next, i, q, hull_tri[i], INVALID, hull_tri[next]);
+        hull_tri[i] = legalize(t + 2);
+        hull_next[next] = next; // Mark as removed
+        next = q;
+      }
+
+      // Walk backward from the other side, adding more triangles and flipping
+      if (e == start) {
+        while (q = hull_prev[e], orient(x, y, coords[2 * q], coords[2 * q + 1],
+                                        coords[2 * e], coords[2 * e + 1])) {
+          t = add_triangle(q, i, e, INVALID, hull_tri[e], hull_tri[q]);
+          legalize(t + 2);
+          hull_tri[q] = t;
+          hull_next[e] = e; // Mark as removed
+          e = q;
+        }
+      }
+
+      // Update the hull indices
+      hull_start = hull_prev[i] = e;
+      hull_next[e] = hull_prev[next] = i;
+      hull_next[i] = next;
 
-    triangles = std::move(new_triangles);
+      hull_hash[hash_key(x, y)] = i;
+      hull_hash[hash_key(coords[2 * e], coords[2 * e + 1])] = e;
+    }
   }
 
   bool inCircle(const Vector2 &a, const Vector2 &b, const Vector2 &c,
@@ -264,9 +481,9 @@ private:
   }
 
   // TODO: Replace Temporaty fix
-  void bruteforceDelaunayEdges(std::vector<T> &vertices) {
+  void bruteforceDelaunayEdges(const std::vector<T> &vertices) {
     int n = vertices.size();
-    edges.clear();
+    graph.reset(static_cast<uint32_t>(n));
 
     for (int i = 0; i < n - 2; ++i) {
       for (int j = i + 1; j < n - 1; ++j) {
@@ -282,19 +499,14 @@ private:
             }
           }
           if (valid) {
-            edges.insert(Edge<T>(
-                &vertices[std::min(i, j)], &vertices[std::max(i, j)],
-                distance(vertices[std::min(i, j)], vertices[std::max(i, j)])));
-            edges.insert(Edge<T>(
-                &vertices[std::min(j, k)], &vertices[std::max(j, k)],
-                distance(vertices[std::min(j, k)], vertices[std::max(j, k)])));
-            edges.insert(Edge<T>(
-                &vertices[std::min(k, i)], &vertices[std::max(k, i)],
-                distance(vertices[std::min(k, i)], vertices[std::max(k, i)])));
+            add_edge(vertices, i, j);
+            add_edge(vertices, j, k);
+            add_edge(vertices, k, i);
           }
         }
       }
     }
+    graph.finalize();
   }
 
   double distance(const T *vertex1, const T *vertex2) {
@@ -304,28 +516,6 @@ private:
   double distance(const T &vertex1, const T &vertex2) {
     return (vertex1.position - vertex2.position).length();
   }
-  void removeDuplicates(std::vector<Edge<T>> &edges) {
-    // Sort the edges vector
-    std::sort(edges.begin(), edges.end());
-
-    // Use std::unique to move duplicates to the end of the vector
-    auto uniqueEnd = std::unique(edges.begin(), edges.end());
-
-    // Erase the duplicates from the vector
-    edges.erase(uniqueEnd, edges.end());
-  }
 };
 } // namespace ewdg
-namespace std {
-template <typename T> struct hash<ewdg::Edge<T>> {
-  size_t operator()(const ewdg::Edge<T> &edge) const {
-    // Assuming `Edge` has `from`, `to`, and `weight` members
-    size_t hashValue = 17;
-    hashValue = hashValue * 31 + std::hash<T>()(*edge.from);
-    hashValue = hashValue * 31 + std::hash<T>()(*edge.to);
-    hashValue = hashValue * 31 + std::hash<double>()(edge.weight);
-    return hashValue;
-  }
-};
-} // namespace std
 #endif // DELAUNAY_TRIANGULATION_H_
@@ -0,0 +1,53 @@
+#ifndef DISJOINT_SET_H_
+#define DISJOINT_SET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ewdg {
+// Union-find over the indices [0, count), with path halving and union by
+// rank. Both operations are iterative, so deep trees cannot overflow the
+// stack.
+class DisjointSet {
+public:
+  void make_sets(uint32_t count) {
+    parent.resize(count);
+    rank.assign(count, 0);
+    for (uint32_t v = 0; v < count; v++) {
+      parent[v] = v;
+    }
+  }
+
+  size_t size() const { return parent.size(); }
+
+  uint32_t find_set(uint32_t v) {
+    while (parent[v] != v) {
+      parent[v] = parent[parent[v]];
+      v = parent[v];
+    }
+    return v;
+  }
+
+  // Returns false if a and b already were in the same set
+  bool union_sets(uint32_t a, uint32_t b) {
+    a = find_set(a);
+    b = find_set(b);
+    if (a == b)
+      return false;
+    if (rank[a] < rank[b]) {
+      parent[a] = b;
+    } else {
+      parent[b] = a;
+      if (rank[a] == rank[b])
+        rank[a]++;
+    }
+    return true;
+  }
+
+private:
+  std::vector<uint32_t> parent;
+  std::vector<uint8_t> rank;
+};
+} // namespace ewdg
+#endif // DISJOINT_SET_H_
@@ -0,0 +1,206 @@
+#ifndef GRAPH_H_
+#define GRAPH_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace ewdg {
+// Undirected edge between two vertex indices, stored with from < to
+struct GraphEdge {
+  uint32_t from;
+  uint32_t to;
+  double weight;
+
+  GraphEdge() : from(0), to(0), weight(0) {}
+  GraphEdge(uint32_t a, uint32_t b, double w)
+      : from(std::min(a, b)), to(std::max(a, b)), weight(w) {}
+
+  // Orders by weight, ties are broken by the vertices so distinct edges of
+  // equal length stay distinct
+  bool operator<(const GraphEdge &other) const {
+    if (weight != other.weight)
+      return weight < other.weight;
+    if (from != other.from)
+      return from < other.from;
+    return to < other.to;
+  }
+
+  bool operator==(const GraphEdge &other) const {
+    return from == other.from && to == other.to;
+  }
+};
+
+// Graph over vertex indices with a contiguous edge array and CSR adjacency.
+// Vertices are indices into some external array, e.g. Dungeon::main_rooms,
+// so the graph stays valid when that array is moved or serialized.
+class Graph {
+public:
+  struct Neighbors {
+    const uint32_t *first;
+    const uint32_t *last;
+    const uint32_t *begin() const { return first; }
+    const uint32_t *end() const { return last; }
+    size_t size() const { return last - first; }
+  };
+
+  uint32_t vertex_count = 0;
+  std::vector<GraphEdge> edges;
+
+  void reset(uint32_t vertices) {
+    vertex_count = vertices;
+    edges.clear();
+    offsets.clear();
+    adjacency.clear();
+    adjacency_edges.clear();
+  }
+
+  void clear() { reset(0); }
+
+  void add_edge(uint32_t a, uint32_t b, double weight) {
+    edges.emplace_back(a, b, weight);
+  }
+
+  // Sorts the edges by weight and removes duplicates, which have the same
+  // weight and so end up next to each other, then rebuilds the adjacency
+  void finalize() {
+    sort_edges();
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    build_adjacency();
+  }
+
+  // Sorts the edges by (weight, from, to). The weights are non-negative, so
+  // their bit patterns order like the values and an LSD radix sort over them
+  // runs in linear time. Runs of equal weight are then sorted by vertex.
+  void sort_edges() {
+    if (edges.size() < RADIX_THRESHOLD) {
+      std::sort(edges.begin(), edges.end());
+      return;
+    }
+
+    size_t n = edges.size();
+    keys.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      std::memcpy(&keys[i], &edges[i].weight, sizeof(uint64_t));
+    }
+
+    // One pass fills the histograms of every digit
+    const int passes = (64 + RADIX_BITS - 1) / RADIX_BITS;
+    histograms.assign(passes * RADIX_SIZE, 0);
+    for (uint64_t key : keys) {
+      for (int p = 0; p < passes; p++) {
+        size_t digit = (key >> (p * RADIX_BITS)) & RADIX_MASK;
+        histograms[p * RADIX_SIZE + digit]++;
+      }
+    }
+
+    sorted_edges.resize(n);
+    sorted_keys.resize(n);
+    for (int p = 0; p < passes; p++) {
+      uint32_t *count = histograms.data() + p * RADIX_SIZE;
+      int shift = p * RADIX_BITS;
+      // Skip digits every key shares, e.g. the exponent's high bits
+      if (count[(keys[0] >> shift) & RADIX_MASK] == n)
+        continue;
+      uint32_t offset = 0;
+      for (size_t d = 0; d < RADIX_SIZE; d++) {
+        uint32_t c = count[d];
+        count[d] = offset;
+        offset += c;
+      }
+      for (size_t i = 0; i < n; i++) {
+        uint32_t slot = count[(keys[i] >> shift) & RADIX_MASK]++;
+        sorted_edges[slot] = edges[i];
+        sorted_keys[slot] = keys[i];
+      }
+      edges.swap(sorted_edges);
+      keys.swap(sorted_keys);
+    }
+
+    auto by_vertex = [](const GraphEdge &a, const GraphEdge &b) {
+      return a.from != b.from ? a.from < b.from : a.to < b.to;
+    };
+    for (size_t first = 0; first < n;) {
+      size_t last = first + 1;
+      while (last < n && keys[last] == keys[first]) {
+        last++;
+      }
+      if (last - first > 1)
+        std::sort(edges.begin() + first, edges.begin() + last, by_vertex);
+      first = last;
+    }
+  }
+
+  void build_adjacency() {
+    offsets.assign(vertex_count + 1, 0);
+    for (const GraphEdge &e : edges) {
+      offsets[e.from + 1]++;
+      offsets[e.to + 1]++;
+    }
+    for (uint32_t v = 0; v < vertex_count; v++) {
+      offsets[v + 1] += offsets[v];
+    }
+    adjacency.resize(2 * edges.size());
+    adjacency_edges.resize(2 * edges.size());
+    std::vector<uint32_t> &cursor = scratch;
+    cursor.assign(offsets.begin(), offsets.end() - 1);
+    for (uint32_t i = 0; i < edges.size(); i++) {
+      const GraphEdge &e = edges[i];
+      adjacency_edges[cursor[e.from]] = i;
+      adjacency[cursor[e.from]++] = e.to;
+      adjacency_edges[cursor[e.to]] = i;
+      adjacency[cursor[e.to]++] = e.from;
+    }
+  }
+
+  // Renames vertex v to new_index[v], e.g. after the external array was
+  // reordered. Restores the edge order, and the adjacency if it was built.
+  void remap(const std::vector<uint32_t> &new_index) {
+    for (GraphEdge &e : edges) {
+      e = GraphEdge(new_index[e.from], new_index[e.to], e.weight);
+    }
+    sort_edges();
+    if (!offsets.empty())
+      build_adjacency();
+  }
+
+  size_t size() const { return edges.size(); }
+  bool empty() const { return edges.empty(); }
+
+  // Requires build_adjacency or finalize
+  Neighbors neighbors(uint32_t v) const {
+    return {adjacency.data() + offsets[v], adjacency.data() + offsets[v + 1]};
+  }
+
+  // Edge indices matching neighbors(v), requires build_adjacency or finalize
+  Neighbors incident_edges(uint32_t v) const {
+    return {adjacency_edges.data() + offsets[v],
+            adjacency_edges.data() + offsets[v + 1]};
+  }
+
+  bool contains(uint32_t a, uint32_t b) const {
+    for (uint32_t n : neighbors(a)) {
+      if (n == b)
+        return true;
+    }
+    return false;
+  }
+
+private:
+  static constexpr size_t RADIX_THRESHOLD = 256;
+  static constexpr int RADIX_BITS = 11;
+  static constexpr size_t RADIX_SIZE = size_t(1) << RADIX_BITS;
+  static constexpr uint64_t RADIX_MASK = RADIX_SIZE - 1;
+
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> adjacency;
+  std::vector<uint32_t> adjacency_edges;
+  std::vector<uint32_t> scratch;
+  std::vector<uint64_t> keys, sorted_keys;
+  std::vector<uint32_t> histograms;
+  std::vector<GraphEdge> sorted_edges;
+};
+} // namespace ewdg
+#endif // GRAPH_H_
@@ -0,0 +1,160 @@
+#ifndef MINIMUM_SPANNING_TREE_H_
+#define MINIMUM_SPANNING_TREE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "math/disjoint_set.h"
+#include "math/graph.h"
+#include "thread_pool.h"
+
+namespace ewdg {
+// Builds minimum spanning trees (forests for disconnected graphs) of graphs
+// whose edges are sorted by (weight, from, to), as Graph::finalize leaves
+// them. Edges are compared by their index in that order, which makes the
+// tree unique: Kruskal and the parallel Boruvka return the same edges.
+// Scratch buffers are kept between calls.
+class MinimumSpanningTree {
+public:
+  // Graphs with fewer vertices are always built serially
+  static constexpr uint32_t PARALLEL_THRESHOLD = 20000;
+
+  // Writes the tree edges to tree, sorted like the graph's edges. Uses
+  // Boruvka on the pool for large graphs and Kruskal otherwise.
+  void build(const Graph &graph, Graph &tree, ThreadPool *pool = nullptr) {
+    if (pool && pool->size() > 1 && graph.vertex_count >= PARALLEL_THRESHOLD)
+      boruvka(graph, tree, *pool);
+    else
+      kruskal(graph, tree);
+  }
+
+  // Single pass over the already sorted edges
+  void kruskal(const Graph &graph, Graph &tree) {
+    tree.reset(graph.vertex_count);
+    sets.make_sets(graph.vertex_count);
+    uint32_t needed = graph.vertex_count > 0 ? graph.vertex_count - 1 : 0;
+    for (const GraphEdge &edge : graph.edges) {
+      if (tree.edges.size() == needed)
+        break;
+      if (sets.union_sets(edge.from, edge.to))
+        tree.edges.push_back(edge);
+    }
+    tree.build_adjacency();
+  }
+
+  // Every round each component picks its cheapest outgoing edge and the
+  // picked edges are merged, which at least halves the component count. The
+  // scan for the cheapest edges runs in parallel and drops edges that have
+  // become internal to a component, the merge is serial.
+  void boruvka(const Graph &graph, Graph &tree, ThreadPool &pool) {
+    uint32_t n = graph.vertex_count;
+    tree.reset(n);
+    sets.make_sets(n);
+    component.resize(n);
+    merged_into.resize(n);
+    roots.resize(n);
+    for (uint32_t v = 0; v < n; v++) {
+      component[v] = v;
+      roots[v] = v;
+    }
+    if (best_capacity < n) {
+      best.reset(new std::atomic<uint32_t>[n]);
+      best_capacity = n;
+    }
+    live.resize(graph.edges.size());
+    for (uint32_t i = 0; i < live.size(); i++) {
+      live[i] = i;
+    }
+    chosen.clear();
+
+    const GraphEdge *edges = graph.edges.data();
+    while (!live.empty()) {
+      for (uint32_t c : roots) {
+        best[c].store(NONE, std::memory_order_relaxed);
+      }
+
+      // Every chunk compacts the live edges of its own range
+      size_t chunks = (live.size() + GRAIN - 1) / GRAIN;
+      chunk_sizes.assign(chunks, 0);
+      pool.parallel_for(live.size(), GRAIN, [&](size_t a, size_t b) {
+        size_t kept = a;
+        for (size_t k = a; k < b; k++) {
+          uint32_t i = live[k];
+          uint32_t cu = component[edges[i].from];
+          uint32_t cv = component[edges[i].to];
+          if (cu == cv)
+            continue;
+          live[kept++] = i;
+          fetch_min(best[cu], i);
+          fetch_min(best[cv], i);
+        }
+        chunk_sizes[a / GRAIN] = kept - a;
+      });
+      size_t live_count = 0;
+      for (size_t c = 0; c < chunks; c++) {
+        std::copy(live.begin() + c * GRAIN,
+                  live.begin() + c * GRAIN + chunk_sizes[c],
+                  live.begin() + live_count);
+        live_count += chunk_sizes[c];
+      }
+      live.resize(live_count);
+      if (live.empty())
+        break;
+
+      for (uint32_t c : roots) {
+        uint32_t i = best[c].load(std::memory_order_relaxed);
+        // Both endpoints' components may have picked the same edge
+        if (i != NONE && sets.union_sets(edges[i].from, edges[i].to))
+          chosen.push_back(i);
+      }
+      // Resolve every old component to its new root once, so relabelling a
+      // vertex is a single lookup instead of a walk up the tree
+      for (uint32_t c : roots) {
+        merged_into[c] = sets.find_set(c);
+      }
+      auto merged = [&](uint32_t c) { return merged_into[c] != c; };
+      roots.erase(std::remove_if(roots.begin(), roots.end(), merged),
+                  roots.end());
+      pool.parallel_for(n, GRAIN, [&](size_t a, size_t b) {
+        for (size_t v = a; v < b; v++) {
+          component[v] = merged_into[component[v]];
+        }
+      });
+    }
+
+    std::sort(chosen.begin(), chosen.end());
+    tree.edges.reserve(chosen.size());
+    for (uint32_t i : chosen) {
+      tree.edges.push_back(edges[i]);
+    }
+    tree.build_adjacency();
+  }
+
+private:
+  static constexpr uint32_t NONE = UINT32_MAX;
+  static constexpr size_t GRAIN = 16384;
+
+  DisjointSet sets;
+  std::vector<uint32_t> component;
+  std::vector<uint32_t> merged_into;
+  std::vector<uint32_t> roots;
+  std::vector<uint32_t> live;
+  std::vector<size_t> chunk_sizes;
+  std::unique_ptr<std::atomic<uint32_t>[]> best;
+  size_t best_capacity = 0;
+  std::vector<uint32_t> chosen;
+
+  static void fetch_min(std::atomic<uint32_t> &target, uint32_t value) {
+    uint32_t current = target.load(std::memory_order_relaxed);
+    while (value < current &&
+           !target.compare_exchange_weak(current, value,
+                                         std::memory_order_relaxed)) {
+    }
+  }
+};
+} // namespace ewdg
+#endif // MINIMUM_SPANNING_TREE_H_
@@ -0,0 +1,61 @@
+#ifndef MORTON_H_
+#define MORTON_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ewdg {
+// Spreads the low 16 bits of v over the even bits of the result
+inline uint32_t morton_spread(uint32_t v) {
+  v &= 0xffff;
+  v = (v | (v << 8)) & 0x00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+// Position of the cell (x, y) of a 65536x65536 grid along the Z-order curve
+inline uint32_t morton_code(uint32_t x, uint32_t y) {
+  return morton_spread(x) | (morton_spread(y) << 1);
+}
+
+// Fills order with the indices of items along a Z-order curve over the
+// bounding box of their positions, so items close in space end up close in
+// the order. Ties keep their original order. keys is scratch.
+template <typename T>
+void morton_order(const std::vector<T> &items, std::vector<uint32_t> &order,
+                  std::vector<uint64_t> &keys) {
+  size_t n = items.size();
+  order.resize(n);
+  if (n == 0)
+    return;
+  double min_x = items[0].position.x, max_x = min_x;
+  double min_y = items[0].position.y, max_y = min_y;
+  for (const T &item : items) {
+    min_x = std::min(min_x, item.position.x);
+    max_x = std::max(max_x, item.position.x);
+    min_y = std::min(min_y, item.position.y);
+    max_y = std::max(max_y, item.position.y);
+  }
+  double scale_x = max_x > min_x ? 65535.0 / (max_x - min_x) : 0.0;
+  double scale_y = max_y > min_y ? 65535.0 / (max_y - min_y) : 0.0;
+
+  // The index in the low bits keeps the keys unique and the sort stable
+  keys.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    uint32_t x =
+        static_cast<uint32_t>((items[i].position.x - min_x) * scale_x);
+    uint32_t y =
+        static_cast<uint32_t>((items[i].position.y - min_y) * scale_y);
+    keys[i] = (static_cast<uint64_t>(morton_code(x, y)) << 32) | i;
+  }
+  std::sort(keys.begin(), keys.end());
+  for (size_t k = 0; k < n; k++) {
+    order[k] = static_cast<uint32_t>(keys[k]);
+  }
+}
+} // namespace ewdg
+#endif // MORTON_H_
@@ -0,0 +1,65 @@
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <cstdint>
+
+namespace ewdg {
+// xoshiro256** generator seeded through splitmix64. Unlike the standard
+// distributions the output only depends on the seed, so the same seed gives
+// the same sequence on every platform and standard library.
+class Random {
+public:
+  explicit Random(uint64_t seed = 0) { set_seed(seed); }
+
+  void set_seed(uint64_t seed) {
+    for (uint64_t &s : state) {
+      seed += 0x9e3779b97f4a7c15ull;
+      uint64_t z = seed;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      s = z ^ (z >> 31);
+    }
+  }
+
+  uint64_t next() {
+    const uint64_t result = rotl(state[1] * 5, 7) * 9;
+    const uint64_t t = state[1] << 17;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+
+    state[2] ^= t;
+    state[3] = rotl(state[3], 45);
+
+    return result;
+  }
+
+  // Uniform float in [min, max)
+  float next_float(float min, float max) {
+    float unit = static_cast<float>(next() >> 40) * (1.0f / 16777216.0f);
+    return min + (max - min) * unit;
+  }
+
+  // Uniform integer in [min, max]
+  int64_t next_int(int64_t min, int64_t max) {
+    uint64_t range = static_cast<uint64_t>(max - min) + 1;
+    if (range == 0)
+      return static_cast<int64_t>(next());
+    // Reject the top partial range to avoid modulo bias
+    uint64_t limit = UINT64_MAX - UINT64_MAX % range;
+    uint64_t value;
+    do {
+      value = next();
+    } while (value >= limit);
+    return min + static_cast<int64_t>(value % range);
+  }
+
+private:
+  uint64_t state[4];
+
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+} // namespace ewdg
+#endif // RANDOM_H_
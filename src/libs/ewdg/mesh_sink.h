@@ -0,0 +1,72 @@
+#ifndef MESH_SINK_H_
+#define MESH_SINK_H_
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "math/vector3.h"
+
+namespace ewdg {
+// Mesh sinks receive the geometry written by the generate_3d_mesh functions.
+// A sink provides:
+//   size_t vertex_count() const            vertices written so far
+//   void add_vertex(double x, double y, double z)
+//   void add_index(int32_t index)          relative to the whole mesh
+
+// Appends to a pair of std::vectors
+struct VectorSink {
+  std::vector<Vector3> &vertices;
+  std::vector<int32_t> &indices;
+
+  VectorSink(std::vector<Vector3> &vertices, std::vector<int32_t> &indices)
+      : vertices(vertices), indices(indices) {}
+
+  size_t vertex_count() const { return vertices.size(); }
+  void add_vertex(double x, double y, double z) {
+    vertices.emplace_back(x, y, z);
+  }
+  void add_index(int32_t index) { indices.push_back(index); }
+};
+
+// Writes packed xyz triples of Real and indices into caller owned, pre-sized
+// buffers, e.g. the memory of an engine's vertex and index arrays.
+template <typename Real> struct BufferSink {
+  Real *vertices;
+  size_t vertex_capacity;
+  int32_t *indices;
+  size_t index_capacity;
+  size_t vertices_written = 0;
+  size_t indices_written = 0;
+
+  BufferSink(Real *vertices, size_t vertex_capacity, int32_t *indices,
+             size_t index_capacity)
+      : vertices(vertices), vertex_capacity(vertex_capacity), indices(indices),
+        index_capacity(index_capacity) {}
+
+  size_t vertex_count() const { return vertices_written; }
+  void add_vertex(double x, double y, double z) {
+    assert(vertices_written < vertex_capacity);
+    Real *v = vertices + 3 * vertices_written++;
+    v[0] = static_cast<Real>(x);
+    v[1] = static_cast<Real>(y);
+    v[2] = static_cast<Real>(z);
+  }
+  void add_index(int32_t index) {
+    assert(indices_written < index_capacity);
+    indices[indices_written++] = index;
+  }
+};
+
+// Only counts, used to size buffers before writing into them
+struct CountingSink {
+  size_t vertices = 0;
+  size_t indices = 0;
+
+  size_t vertex_count() const { return vertices; }
+  void add_vertex(double, double, double) { vertices++; }
+  void add_index(int32_t) { indices++; }
+};
+} // namespace ewdg
+#endif // MESH_SINK_H_
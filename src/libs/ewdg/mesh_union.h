@@ -0,0 +1,485 @@
+#ifndef MESH_UNION_H_
+#define MESH_UNION_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "math/vector2.h"
+#include "math/vector3.h"
+#include "mesh_sink.h"
+#include "path.h"
+#include "room.h"
+
+namespace ewdg {
+// Meshes the union of the floor plans of rooms and corridors, instead of
+// one closed box per room and corridor segment. Every footprint is an axis
+// aligned rectangle, the union is found with a sweep over the x coordinates
+// of their sides: each slab between two neighbouring coordinates is covered
+// by a sorted list of disjoint y intervals. Floors and ceilings are one quad
+// per run of slabs with the same interval, walls only follow the outline of
+// the union, so no faces end up inside it. Openings between rooms and
+// corridors come out of the union, entrance_points are not used.
+//
+// Every edge is split at the floor corners and wall ends that lie on it, so
+// faces only ever meet vertex to vertex and the mesh has no T-junctions.
+// Floors with such points on their sides become a fan around their center.
+// Vertices are welded through a hash table on their exact position, so
+// neighbouring faces share them. All buffers, the table included, are kept
+// between builds.
+class MeshUnion {
+public:
+  void clear() { rects.clear(); }
+
+  // Ignored if the rectangle has no area
+  void add_rect(double x0, double y0, double x1, double y1) {
+    if (x0 < x1 && y0 < y1)
+      rects.push_back({x0, y0, x1, y1});
+  }
+
+  void add_room(const Room &r) {
+    // Computed like the walls in Path, so corridors touch rooms exactly
+    add_rect(r.position.x - r.width / 2, r.position.y - r.height / 2,
+             r.position.x + r.width / 2, r.position.y + r.height / 2);
+  }
+
+  // The boxes Path::generate_3d_mesh would emit
+  void add_path(const Path &p) {
+    double half_width = p.width / 2;
+    if (!p.polyline.empty()) {
+      size_t last = p.polyline.size() - 1;
+      for (size_t i = 0; i < last; i++) {
+        add_segment(p.polyline[i], p.polyline[i + 1], half_width, i > 0,
+                    i + 1 < last);
+      }
+    } else if (p.straight_path) {
+      add_segment(p.start, p.end, half_width, false, false);
+    } else {
+      add_segment(p.start, p.intersektion, half_width, false, true);
+      add_segment(p.end, p.intersektion, half_width, false, true);
+    }
+  }
+
+  // Computes the mesh of the rectangles added since clear, with walls of
+  // the given height
+  void build(double height) {
+    vertices.clear();
+    indices.clear();
+    vertex_keys.clear();
+    std::fill(weld_slots.begin(), weld_slots.end(), EMPTY_SLOT);
+    sweep();
+
+    // Floors and ceilings, wound like Room's
+    for (const Rect2 &r : floors) {
+      const Vector2 corners[4] = {
+          {r.x0, r.y0}, {r.x1, r.y0}, {r.x1, r.y1}, {r.x0, r.y1}};
+      outline.clear();
+      for (int c = 0; c < 4; c++) {
+        outline.push_back(corners[c]);
+        add_splits(corners[c], corners[(c + 1) % 4], outline);
+      }
+      for (bool ceiling : {false, true}) {
+        double y = ceiling ? height : 0;
+        if (outline.size() == 4) {
+          int32_t quad[4] = {vertex(r.x0, y, r.y0), vertex(r.x1, y, r.y0),
+                             vertex(r.x1, y, r.y1), vertex(r.x0, y, r.y1)};
+          static constexpr int floor_order[6] = {0, 1, 2, 0, 2, 3};
+          static constexpr int ceiling_order[6] = {3, 2, 0, 2, 1, 0};
+          for (int k : ceiling ? ceiling_order : floor_order) {
+            indices.push_back(quad[k]);
+          }
+          continue;
+        }
+        int32_t center = vertex((r.x0 + r.x1) / 2, y, (r.y0 + r.y1) / 2);
+        int32_t first = vertex(outline[0].x, y, outline[0].y);
+        int32_t previous = first;
+        for (size_t i = 1; i <= outline.size(); i++) {
+          int32_t current = i < outline.size()
+                                ? vertex(outline[i].x, y, outline[i].y)
+                                : first;
+          indices.push_back(center);
+          indices.push_back(ceiling ? current : previous);
+          indices.push_back(ceiling ? previous : current);
+          previous = current;
+        }
+      }
+    }
+
+    // Walls run clockwise around the covered area, like Room's walls. One
+    // quad per piece between the points on the wall.
+    for (const Wall &w : walls) {
+      outline.clear();
+      outline.push_back(w.from);
+      add_splits(w.from, w.to, outline);
+      outline.push_back(w.to);
+      for (size_t i = 0; i + 1 < outline.size(); i++) {
+        const Vector2 &from = outline[i], &to = outline[i + 1];
+        int32_t quad[4] = {
+            vertex(from.x, 0, from.y), vertex(from.x, height, from.y),
+            vertex(to.x, 0, to.y), vertex(to.x, height, to.y)};
+        for (int k : {0, 1, 2, 1, 3, 2}) {
+          indices.push_back(quad[k]);
+        }
+      }
+    }
+  }
+
+  // Number of vertices and indices write produces, after build
+  std::pair<size_t, size_t> mesh_size() const {
+    return {vertices.size(), indices.size()};
+  }
+
+  template <typename Sink> void write(Sink &sink) const {
+    int32_t base = static_cast<int32_t>(sink.vertex_count());
+    for (const Vector3 &v : vertices) {
+      sink.add_vertex(v.x, v.y, v.z);
+    }
+    for (int32_t i : indices) {
+      sink.add_index(base + i);
+    }
+  }
+
+private:
+  struct Rect2 {
+    double x0, y0, x1, y1;
+  };
+
+  struct Interval {
+    double y0, y1;
+  };
+
+  struct Wall {
+    Vector2 from, to;
+  };
+
+  // Horizontal wall piece along one slab, merged with its neighbours later.
+  // upper is set for the y1 end of an interval.
+  struct Edge {
+    double y;
+    bool upper;
+    double x0, x1;
+
+    bool operator<(const Edge &other) const {
+      if (upper != other.upper)
+        return upper < other.upper;
+      if (y != other.y)
+        return y < other.y;
+      return x0 < other.x0;
+    }
+  };
+
+  struct VertexKey {
+    double x, y, z;
+    bool operator==(const VertexKey &other) const {
+      return x == other.x && y == other.y && z == other.z;
+    }
+  };
+
+  struct VertexHash {
+    size_t operator()(const VertexKey &k) const {
+      uint64_t bits[3];
+      std::memcpy(bits, &k, sizeof(bits));
+      uint64_t h = bits[0] * 0x9e3779b97f4a7c15ull;
+      h = (h ^ (h >> 29) ^ bits[1]) * 0xbf58476d1ce4e5b9ull;
+      h = (h ^ (h >> 32) ^ bits[2]) * 0x94d049bb133111ebull;
+      return static_cast<size_t>(h ^ (h >> 31));
+    }
+  };
+
+  std::vector<Rect2> rects;
+  std::vector<double> xs;
+  std::vector<Rect2> active;
+  // Covered intervals of slab k are slab_intervals[slab_first[k]] up to
+  // slab_intervals[slab_first[k + 1]]
+  std::vector<Interval> slab_intervals;
+  std::vector<size_t> slab_first;
+  std::vector<Interval> scratch;
+  std::vector<double> breaks;
+  std::vector<Rect2> floors;
+  std::vector<size_t> open_floors;
+  std::vector<size_t> next_open_floors;
+  std::vector<Edge> edges;
+  std::vector<Wall> walls;
+  // Floor corners and wall ends, sorted by x then y and by y then x
+  std::vector<Vector2> points_by_x;
+  std::vector<Vector2> points_by_y;
+  // Outline of one floor or the pieces of one wall
+  std::vector<Vector2> outline;
+  std::vector<Vector3> vertices;
+  std::vector<int32_t> indices;
+  // Open addressing table of vertex indices, EMPTY_SLOT where free. Its
+  // size is a power of two, at least twice the number of vertices.
+  static constexpr int32_t EMPTY_SLOT = -1;
+  std::vector<int32_t> weld_slots;
+  // Exact position of each vertex
+  std::vector<VertexKey> vertex_keys;
+
+  // Box around the axis aligned segment a to b, extended by half_width at
+  // the ends that are inner corners
+  void add_segment(const Vector2 &a, const Vector2 &b, double half_width,
+                   bool extend_a, bool extend_b) {
+    double ea = extend_a ? half_width : 0;
+    double eb = extend_b ? half_width : 0;
+    if (a.y == b.y) {
+      double x0 = a.x < b.x ? a.x - ea : b.x - eb;
+      double x1 = a.x < b.x ? b.x + eb : a.x + ea;
+      add_rect(x0, a.y - half_width, x1, a.y + half_width);
+    } else {
+      double y0 = a.y < b.y ? a.y - ea : b.y - eb;
+      double y1 = a.y < b.y ? b.y + eb : a.y + ea;
+      add_rect(a.x - half_width, y0, a.x + half_width, y1);
+    }
+  }
+
+  int32_t vertex(double x, double y, double z) {
+    if (2 * (vertex_keys.size() + 1) > weld_slots.size())
+      grow_weld_table();
+    VertexKey key{x, y, z};
+    size_t mask = weld_slots.size() - 1;
+    for (size_t slot = VertexHash()(key) & mask;; slot = (slot + 1) & mask) {
+      int32_t v = weld_slots[slot];
+      if (v == EMPTY_SLOT) {
+        v = static_cast<int32_t>(vertices.size());
+        weld_slots[slot] = v;
+        vertex_keys.push_back(key);
+        vertices.emplace_back(x, y, z);
+        return v;
+      }
+      if (vertex_keys[v] == key)
+        return v;
+    }
+  }
+
+  void grow_weld_table() {
+    weld_slots.assign(std::max<size_t>(64, 2 * weld_slots.size()),
+                      EMPTY_SLOT);
+    size_t mask = weld_slots.size() - 1;
+    for (size_t v = 0; v < vertex_keys.size(); v++) {
+      size_t slot = VertexHash()(vertex_keys[v]) & mask;
+      while (weld_slots[slot] != EMPTY_SLOT) {
+        slot = (slot + 1) & mask;
+      }
+      weld_slots[slot] = static_cast<int32_t>(v);
+    }
+  }
+
+  void sweep() {
+    xs.clear();
+    for (const Rect2 &r : rects) {
+      xs.push_back(r.x0);
+      xs.push_back(r.x1);
+    }
+    std::sort(xs.begin(), xs.end());
+    xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+    std::sort(rects.begin(), rects.end(),
+              [](const Rect2 &a, const Rect2 &b) { return a.x0 < b.x0; });
+
+    // Covered y intervals of every slab
+    slab_intervals.clear();
+    slab_first.clear();
+    active.clear();
+    size_t next_rect = 0;
+    for (size_t k = 0; k + 1 < xs.size(); k++) {
+      slab_first.push_back(slab_intervals.size());
+      auto ended = [&](const Rect2 &r) { return r.x1 <= xs[k]; };
+      active.erase(std::remove_if(active.begin(), active.end(), ended),
+                   active.end());
+      while (next_rect < rects.size() && rects[next_rect].x0 <= xs[k]) {
+        active.push_back(rects[next_rect++]);
+      }
+      scratch.clear();
+      for (const Rect2 &r : active) {
+        scratch.push_back({r.y0, r.y1});
+      }
+      std::sort(scratch.begin(), scratch.end(),
+                [](const Interval &a, const Interval &b) {
+                  return a.y0 < b.y0;
+                });
+      for (const Interval &i : scratch) {
+        // Touching intervals merge, so a corridor opens into the room it
+        // ends at
+        if (slab_intervals.size() > slab_first.back() &&
+            i.y0 <= slab_intervals.back().y1)
+          slab_intervals.back().y1 = std::max(slab_intervals.back().y1, i.y1);
+        else
+          slab_intervals.push_back(i);
+      }
+    }
+    slab_first.push_back(slab_intervals.size());
+
+    build_floors();
+    build_walls();
+    build_split_points();
+  }
+
+  static bool less_xy(const Vector2 &a, const Vector2 &b) {
+    return a.x != b.x ? a.x < b.x : a.y < b.y;
+  }
+  static bool less_yx(const Vector2 &a, const Vector2 &b) {
+    return a.y != b.y ? a.y < b.y : a.x < b.x;
+  }
+  static bool same_point(const Vector2 &a, const Vector2 &b) {
+    return a.x == b.x && a.y == b.y;
+  }
+
+  void build_split_points() {
+    points_by_x.clear();
+    for (const Rect2 &r : floors) {
+      points_by_x.push_back({r.x0, r.y0});
+      points_by_x.push_back({r.x1, r.y0});
+      points_by_x.push_back({r.x1, r.y1});
+      points_by_x.push_back({r.x0, r.y1});
+    }
+    for (const Wall &w : walls) {
+      points_by_x.push_back(w.from);
+      points_by_x.push_back(w.to);
+    }
+    std::sort(points_by_x.begin(), points_by_x.end(), less_xy);
+    points_by_x.erase(
+        std::unique(points_by_x.begin(), points_by_x.end(), same_point),
+        points_by_x.end());
+    points_by_y = points_by_x;
+    std::sort(points_by_y.begin(), points_by_y.end(), less_yx);
+  }
+
+  // Appends the points that lie strictly between a and b on the axis
+  // aligned segment from a to b, in order from a
+  void add_splits(const Vector2 &a, const Vector2 &b,
+                  std::vector<Vector2> &out) const {
+    size_t first = out.size();
+    if (a.x == b.x) {
+      Vector2 low(a.x, std::min(a.y, b.y));
+      double high = std::max(a.y, b.y);
+      for (auto it = std::upper_bound(points_by_x.begin(), points_by_x.end(),
+                                      low, less_xy);
+           it != points_by_x.end() && it->x == a.x && it->y < high; ++it) {
+        out.push_back(*it);
+      }
+      if (b.y < a.y)
+        std::reverse(out.begin() + first, out.end());
+    } else {
+      Vector2 low(std::min(a.x, b.x), a.y);
+      double high = std::max(a.x, b.x);
+      for (auto it = std::upper_bound(points_by_y.begin(), points_by_y.end(),
+                                      low, less_yx);
+           it != points_by_y.end() && it->y == a.y && it->x < high; ++it) {
+        out.push_back(*it);
+      }
+      if (b.x < a.x)
+        std::reverse(out.begin() + first, out.end());
+    }
+  }
+
+  const Interval *slab_begin(size_t k) const {
+    return slab_intervals.data() + slab_first[k];
+  }
+  const Interval *slab_end(size_t k) const {
+    return slab_intervals.data() + slab_first[k + 1];
+  }
+
+  // Extends a floor rectangle into the next slab while the slab has an
+  // interval with the same ends
+  void build_floors() {
+    floors.clear();
+    open_floors.clear();
+    for (size_t k = 0; k + 1 < slab_first.size(); k++) {
+      next_open_floors.clear();
+      size_t o = 0;
+      for (const Interval *i = slab_begin(k); i != slab_end(k); i++) {
+        while (o < open_floors.size() && floors[open_floors[o]].y0 < i->y0) {
+          o++;
+        }
+        if (o < open_floors.size() && floors[open_floors[o]].y0 == i->y0 &&
+            floors[open_floors[o]].y1 == i->y1) {
+          floors[open_floors[o]].x1 = xs[k + 1];
+          next_open_floors.push_back(open_floors[o]);
+        } else {
+          next_open_floors.push_back(floors.size());
+          floors.push_back({xs[k], i->y0, xs[k + 1], i->y1});
+        }
+      }
+      std::swap(open_floors, next_open_floors);
+    }
+  }
+
+  // Whether one of the intervals covers y, with the upper end excluded
+  static bool covers(const Interval *begin, const Interval *end, double y) {
+    for (const Interval *i = begin; i != end; i++) {
+      if (i->y0 <= y && y < i->y1)
+        return true;
+    }
+    return false;
+  }
+
+  void build_walls() {
+    walls.clear();
+    size_t slabs = slab_first.size() - 1;
+
+    // Vertical walls where the coverage differs between the slabs on either
+    // side of an x coordinate
+    for (size_t k = 0; k < xs.size(); k++) {
+      const Interval *left_begin = k > 0 ? slab_begin(k - 1) : nullptr;
+      const Interval *left_end = k > 0 ? slab_end(k - 1) : nullptr;
+      const Interval *right_begin = k < slabs ? slab_begin(k) : nullptr;
+      const Interval *right_end = k < slabs ? slab_end(k) : nullptr;
+      breaks.clear();
+      for (const Interval *i = left_begin; i != left_end; i++) {
+        breaks.push_back(i->y0);
+        breaks.push_back(i->y1);
+      }
+      for (const Interval *i = right_begin; i != right_end; i++) {
+        breaks.push_back(i->y0);
+        breaks.push_back(i->y1);
+      }
+      std::sort(breaks.begin(), breaks.end());
+      breaks.erase(std::unique(breaks.begin(), breaks.end()), breaks.end());
+
+      // side is -1 with the area on the left, 1 with it on the right
+      int open_side = 0;
+      double open_y = 0;
+      for (size_t b = 0; b < breaks.size(); b++) {
+        int side = 0;
+        if (b + 1 < breaks.size()) {
+          bool left = covers(left_begin, left_end, breaks[b]);
+          bool right = covers(right_begin, right_end, breaks[b]);
+          side = left == right ? 0 : (left ? -1 : 1);
+        }
+        if (side == open_side)
+          continue;
+        if (open_side == -1)
+          walls.push_back({{xs[k], open_y}, {xs[k], breaks[b]}});
+        else if (open_side == 1)
+          walls.push_back({{xs[k], breaks[b]}, {xs[k], open_y}});
+        open_side = side;
+        open_y = breaks[b];
+      }
+    }
+
+    // Horizontal walls at the ends of every slab interval, merged along x
+    edges.clear();
+    for (size_t k = 0; k < slabs; k++) {
+      for (const Interval *i = slab_begin(k); i != slab_end(k); i++) {
+        edges.push_back({i->y0, false, xs[k], xs[k + 1]});
+        edges.push_back({i->y1, true, xs[k], xs[k + 1]});
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t e = 0; e < edges.size();) {
+      Edge merged = edges[e++];
+      while (e < edges.size() && edges[e].upper == merged.upper &&
+             edges[e].y == merged.y && edges[e].x0 == merged.x1) {
+        merged.x1 = edges[e++].x1;
+      }
+      // Towards +x with the area at larger y, towards -x otherwise
+      if (merged.upper)
+        walls.push_back({{merged.x1, merged.y}, {merged.x0, merged.y}});
+      else
+        walls.push_back({{merged.x0, merged.y}, {merged.x1, merged.y}});
+    }
+  }
+};
+} // namespace ewdg
+#endif // MESH_UNION_H_
@@ -2,10 +2,13 @@
 #define PATH_H_
 
 #include <algorithm>
+#include <cmath>
+#include <utility>
 #include <vector>
 
 #include "math/vector2.h"
 #include "math/vector3.h"
+#include "mesh_sink.h"
 #include "room.h"
 
 namespace ewdg {
@@ -16,70 +19,65 @@ public:
 
   bool straight_path;
 
+  // Corner points of a routed corridor, from start to end. Empty for the
+  // straight and L-shaped paths.
+  std::vector<Vector2> polyline;
+
+  // Corridor along axis aligned points, e.g. from CorridorRouter. The first
+  // and last point lie on the walls of r1 and r2.
+  Path(Room &r1, Room &r2, std::vector<Vector2> points, double width = 2,
+       double floor_to_ceiling = 3)
+      : start(points.front()), end(points.back()), width(width),
+        floor_to_ceiling(floor_to_ceiling), straight_path(points.size() == 2),
+        polyline(std::move(points)) {
+    attach(r1, r2);
+  }
+
+  // Path between r1 and r2 that also adds its entrances to both rooms
   Path(Room &r1, Room &r2, double width = 2, double floor_to_ceiling = 3)
-      : width(width), floor_to_ceiling(floor_to_ceiling) {
+      : Path(plan(r1, r2, width, floor_to_ceiling)) {
+    attach(r1, r2);
+  }
 
-    double overlap_x =
-        std::min(r1.position.x + r1.width / 2, r2.position.x + r2.width / 2) -
-        std::max(r1.position.x - r1.width / 2, r2.position.x - r2.width / 2);
-    double overlap_y =
-        std::min(r1.position.y + r1.height / 2, r2.position.y + r2.height / 2) -
-        std::max(r1.position.y - r1.height / 2, r2.position.y - r2.height / 2);
+  // Computes the path between r1 and r2 without touching the rooms, so
+  // paths can be planned in parallel. attach adds the entrances afterwards.
+  static Path plan(const Room &r1, const Room &r2, double width = 2,
+                   double floor_to_ceiling = 3) {
+    Path p;
+    p.width = width;
+    p.floor_to_ceiling = floor_to_ceiling;
+    p.compute(r1, r2);
+    return p;
+  }
 
-    start = r1.position;
-    end = r2.position;
-    straight_path = false;
+  // Adds the path's entrances to the rooms it was planned between, sorted
+  // into their walls so meshing does not have to
+  void attach(Room &r1, Room &r2) const {
+    r1.add_entrance(start);
+    r2.add_entrance(end);
+    r1.entrance_width = r2.entrance_width = width;
+  }
 
-    if (overlap_x >= width) {
-      straight_path = true;
-      start.x =
-          std::max(r1.position.x - r1.width / 2, r2.position.x - r2.width / 2) +
-          (overlap_x - width) / 2;
-      end.x = start.x;
+  // Unplanned path, to be assigned from plan
+  Path() : width(2), floor_to_ceiling(3), straight_path(true) {}
 
-      if (r1.position.y < r2.position.y) {
-        start.y += r1.height / 2;
-        end.y -= r2.height / 2;
-      } else {
-        start.y -= r1.height / 2;
-        end.y += r2.height / 2;
-      }
-    } else if (overlap_y >= width) {
-      straight_path = true;
-      start.y = std::max(r1.position.y - r1.height / 2,
-                         r2.position.y - r2.height / 2) +
-                (overlap_y - width) / 2;
-      end.y = start.y;
-
-      if (r1.position.x < r2.position.x) {
-        start.x += r1.width / 2;
-        end.x -= r2.width / 2;
-      } else {
-        start.x -= r1.width / 2;
-        end.x += r2.width / 2;
-      }
-    } else {
-      if (r1.position.x < r2.position.x) {
-        start.x += r1.width / 2;
-      } else {
-        start.x -= r1.width / 2;
-      }
-      if (r1.position.y < r2.position.y) {
-        end.y -= r2.height / 2;
-      } else {
-        end.y += r2.height / 2;
-      }
-      intersektion = {end.x, start.y};
-    }
-    r1.entrance_points.push_back(start);
-    r2.entrance_points.push_back(end);
-    r1.entrance_width = r2.entrance_width = width;
+  // Number of vertices and indices generate_3d_mesh produces
+  std::pair<size_t, size_t> mesh_size() const {
+    // One box of 8 vertices and 24 indices per straight segment
+    if (!polyline.empty())
+      return {8 * (polyline.size() - 1), 24 * (polyline.size() - 1)};
+    return straight_path ? std::make_pair<size_t, size_t>(8, 24)
+                         : std::make_pair<size_t, size_t>(16, 48);
   }
 
-  // TODO FIXME: Check for intersections with rooms and other paths and do some
-  // form of union operation.
+  // Overlaps rooms and other paths, see MeshUnion for a mesh of the union
   void generate_3d_mesh(std::vector<Vector3> &vertices,
                         std::vector<int32_t> &indices) const {
+    VectorSink sink(vertices, indices);
+    generate_3d_mesh(sink);
+  }
+
+  template <typename Sink> void generate_3d_mesh(Sink &sink) const {
     double half_width = width / 2;
 
     auto mesh_from_corners = [&](const Vector2 &bl, const Vector2 &br,
@@ -87,7 +85,7 @@ public:
                                  const size_t base_index) {
       for (bool top : {false, true}) {
         auto addVertex = [&](const Vector2 &pos) {
-          vertices.emplace_back(pos.x, top ? floor_to_ceiling : 0, pos.y);
+          sink.add_vertex(pos.x, top ? floor_to_ceiling : 0, pos.y);
         };
         addVertex(bl); // Vertex 0
         addVertex(tr); // Vertex 1
@@ -100,11 +98,31 @@ public:
                2, 1, 5, 5, 6, 2, // Wall1
                7, 3, 0, 0, 4, 7  // Wall2
            }) {
-        indices.push_back(index + base_index);
+        sink.add_index(index + base_index);
       }
     };
 
-    if (straight_path) {
+    if (!polyline.empty()) {
+      // One box per segment. Boxes are extended by half the width at inner
+      // corners so neighbouring segments overlap there.
+      for (size_t i = 0; i + 1 < polyline.size(); i++) {
+        Vector2 a = polyline[i];
+        Vector2 b = polyline[i + 1];
+        Vector2 delta = b - a;
+        double length = std::sqrt(delta.x * delta.x + delta.y * delta.y);
+        Vector2 path_dir = delta / length;
+        if (i > 0)
+          a = a - path_dir * half_width;
+        if (i + 2 < polyline.size())
+          b = b + path_dir * half_width;
+        Vector2 perpendicular_dir = path_dir.perpendicular();
+        mesh_from_corners(a - perpendicular_dir * half_width,
+                          a + perpendicular_dir * half_width,
+                          b - perpendicular_dir * half_width,
+                          b + perpendicular_dir * half_width,
+                          sink.vertex_count());
+      }
+    } else if (straight_path) {
       Vector2 path_dir = (end - start).normalize();
       Vector2 perpendicular_dir = path_dir.perpendicular();
 
@@ -114,7 +132,7 @@ public:
       Vector2 top_right = end + perpendicular_dir * half_width;
 
       mesh_from_corners(bottom_left, bottom_right, top_left, top_right,
-                        vertices.size());
+                        sink.vertex_count());
     } else {
 
       // TODO: Clean up dublicated code
@@ -123,9 +141,6 @@ public:
       Vector2 path_dir = (intersektion - start).normalize();
       Vector2 perpendicular_dir = path_dir.perpendicular();
 
-      double x_diff = half_width * path_dir.x;
-      double y_diff = half_width * path_dir.y;
-
       Vector2 bottom_left = start - perpendicular_dir * half_width;
       Vector2 bottom_right = start + perpendicular_dir * half_width;
 
@@ -139,14 +154,12 @@ public:
           intersektion + perpendicular_dir * half_width + intersektion_offset;
 
       mesh_from_corners(bottom_left, bottom_right, top_left, top_right,
-                        vertices.size());
+                        sink.vertex_count());
 
       // Secound segment
       path_dir = (intersektion - end).normalize();
       perpendicular_dir = path_dir.perpendicular();
 
-      x_diff = half_width * path_dir.x;
-      y_diff = half_width * path_dir.y;
       bottom_left = end - perpendicular_dir * half_width;
       bottom_right = end + perpendicular_dir * half_width;
       intersektion_offset =
@@ -159,7 +172,65 @@ public:
           intersektion + perpendicular_dir * half_width + intersektion_offset;
 
       mesh_from_corners(bottom_left, bottom_right, top_left, top_right,
-                        vertices.size());
+                        sink.vertex_count());
+    }
+  }
+
+private:
+  // Straight path between the overlapping sides of the rooms, or an L-shaped
+  // one through intersektion
+  void compute(const Room &r1, const Room &r2) {
+    double overlap_x =
+        std::min(r1.position.x + r1.width / 2, r2.position.x + r2.width / 2) -
+        std::max(r1.position.x - r1.width / 2, r2.position.x - r2.width / 2);
+    double overlap_y =
+        std::min(r1.position.y + r1.height / 2, r2.position.y + r2.height / 2) -
+        std::max(r1.position.y - r1.height / 2, r2.position.y - r2.height / 2);
+
+    start = r1.position;
+    end = r2.position;
+    straight_path = false;
+
+    if (overlap_x >= width) {
+      straight_path = true;
+      start.x =
+          std::max(r1.position.x - r1.width / 2, r2.position.x - r2.width / 2) +
+          (overlap_x - width) / 2;
+      end.x = start.x;
+
+      if (r1.position.y < r2.position.y) {
+        start.y += r1.height / 2;
+        end.y -= r2.height / 2;
+      } else {
+        start.y -= r1.height / 2;
+        end.y += r2.height / 2;
+      }
+    } else if (overlap_y >= width) {
+      straight_path = true;
+      start.y = std::max(r1.position.y - r1.height / 2,
+                         r2.position.y - r2.height / 2) +
+                (overlap_y - width) / 2;
+      end.y = start.y;
+
+      if (r1.position.x < r2.position.x) {
+        start.x += r1.width / 2;
+        end.x -= r2.width / 2;
+      } else {
+        start.x -= r1.width / 2;
+        end.x += r2.width / 2;
+      }
+    } else {
+      if (r1.position.x < r2.position.x) {
+        start.x += r1.width / 2;
+      } else {
+        start.x -= r1.width / 2;
+      }
+      if (r1.position.y < r2.position.y) {
+        end.y -= r2.height / 2;
+      } else {
+        end.y += r2.height / 2;
+      }
+      intersektion = {end.x, start.y};
     }
   }
 }; // namespace ewdg
@@ -0,0 +1,86 @@
+#ifndef BODY_BUFFER_H_
+#define BODY_BUFFER_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "math/vector2.h"
+
+namespace ewdg {
+// Structure-of-arrays copy of the physics state of a set of Rect bodies.
+// The separation simulation runs over these contiguous arrays and only
+// writes the result back to the bodies once it is done.
+struct BodyBuffer {
+  std::vector<double> x, y;
+  std::vector<double> half_width, half_height;
+  std::vector<double> vx, vy;
+  std::vector<float> mass;
+
+  size_t size() const { return x.size(); }
+
+  template <typename Body> void load(const std::vector<Body> &bodies) {
+    size_t n = bodies.size();
+    x.resize(n);
+    y.resize(n);
+    half_width.resize(n);
+    half_height.resize(n);
+    vx.resize(n);
+    vy.resize(n);
+    mass.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      const Body &b = bodies[i];
+      x[i] = b.position.x;
+      y[i] = b.position.y;
+      half_width[i] = b.width / 2;
+      half_height[i] = b.height / 2;
+      vx[i] = b.velocity.x;
+      vy[i] = b.velocity.y;
+      mass[i] = b.mass;
+    }
+  }
+
+  template <typename Body> void store(std::vector<Body> &bodies) const {
+    for (size_t i = 0; i < bodies.size(); i++) {
+      bodies[i].position = Vector2(x[i], y[i]);
+      bodies[i].velocity = Vector2(vx[i], vy[i]);
+    }
+  }
+
+  Vector2 min_corner(size_t i) const {
+    return {x[i] - half_width[i], y[i] - half_height[i]};
+  }
+
+  Vector2 max_corner(size_t i) const {
+    return {x[i] + half_width[i], y[i] + half_height[i]};
+  }
+
+  bool overlaps(size_t i, size_t j) const {
+    return !(x[i] + half_width[i] < x[j] - half_width[j] ||
+             x[i] - half_width[i] > x[j] + half_width[j] ||
+             y[i] + half_height[i] < y[j] - half_height[j] ||
+             y[i] - half_height[i] > y[j] + half_height[j]);
+  }
+
+  // Same integration as RigidBody2D::apply_force
+  void apply_force(size_t i, const Vector2 &force, float delta) {
+    Vector2 acceleration = force / mass[i];
+    vx[i] += acceleration.x * delta;
+    vy[i] += acceleration.y * delta;
+    if (Vector2(vx[i], vy[i]).length() < 0.01) {
+      vx[i] = 0;
+      vy[i] = 0;
+    }
+  }
+
+  // Same integration as RigidBody2D::simulate
+  void simulate(size_t i, float delta) {
+    x[i] += vx[i] * delta;
+    y[i] += vy[i] * delta;
+  }
+
+  bool is_moving(size_t i) const {
+    return Vector2(vx[i], vy[i]) != Vector2(0, 0);
+  }
+};
+} // namespace ewdg
+#endif // BODY_BUFFER_H_
@@ -0,0 +1,143 @@
+#ifndef BODY_ISLANDS_H_
+#define BODY_ISLANDS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "physics_engine/body_buffer.h"
+
+namespace ewdg {
+// Sleep tracking for the separation simulation. Bodies that touch during a
+// step form an island. Forces only depend on positions and velocities, so an
+// island whose bodies were at rest both before and after a step would repeat
+// that step forever. It is put to sleep and skipped until an awake body
+// overlaps one of its bodies, which wakes the whole island again. Bodies
+// that had a contact in the step do not count as at rest, even if the
+// forces on them cancelled out, so islands never fall asleep overlapping.
+class BodyIslands {
+public:
+  // Steps an island has to stay at rest before it falls asleep, at least
+  // one. One would be enough for the result, waiting keeps bodies that are
+  // pushed around in a crowd from falling asleep and waking up again.
+  uint32_t sleep_steps = 16;
+
+  // Wakes every body of a simulation of count bodies
+  void reset(size_t count) {
+    parent.resize(count);
+    next.resize(count);
+    rested.resize(count);
+    touched.resize(count);
+    rest_steps.assign(count, 0);
+    island_rested.resize(count);
+    asleep.assign(count, 0);
+    awake = count;
+    fell_asleep.clear();
+  }
+
+  size_t size() const { return asleep.size(); }
+  size_t awake_count() const { return awake; }
+  bool is_asleep(size_t i) const { return asleep[i]; }
+
+  // Bodies that fell asleep in the last end_step
+  const std::vector<uint32_t> &fallen_asleep() const { return fell_asleep; }
+
+  // Wakes the island of body i
+  void wake(size_t i) {
+    if (!asleep[i])
+      return;
+    size_t k = i;
+    do {
+      asleep[k] = 0;
+      rest_steps[k] = 0;
+      awake++;
+      k = next[k];
+    } while (k != i);
+  }
+
+  // Call before the forces of a step are applied
+  void begin_step(const BodyBuffer &b) {
+    for (size_t i = 0; i < size(); i++) {
+      if (asleep[i])
+        continue;
+      parent[i] = static_cast<uint32_t>(i);
+      next[i] = static_cast<uint32_t>(i);
+      rested[i] = at_rest(b, i);
+      touched[i] = 0;
+    }
+  }
+
+  // Awake bodies i and j overlapped in this step
+  void add_contact(size_t i, size_t j) {
+    touched[i] = 1;
+    touched[j] = 1;
+    uint32_t a = find(i), c = find(j);
+    if (a != c)
+      parent[c] = a;
+  }
+
+  // Call once the forces of a step are applied. Puts the islands whose bodies
+  // stayed at rest to sleep.
+  void end_step(const BodyBuffer &b) {
+    fell_asleep.clear();
+    for (size_t i = 0; i < size(); i++) {
+      if (!asleep[i] && find(i) == i)
+        island_rested[i] = 1;
+    }
+    for (size_t i = 0; i < size(); i++) {
+      if (asleep[i])
+        continue;
+      uint32_t root = find(i);
+      if (rested[i] && !touched[i] && at_rest(b, i))
+        rest_steps[i]++;
+      else
+        rest_steps[i] = 0;
+      if (rest_steps[i] < sleep_steps)
+        island_rested[root] = 0;
+      if (root != i) {
+        // Link the island's bodies into a ring through its root
+        next[i] = next[root];
+        next[root] = static_cast<uint32_t>(i);
+      }
+    }
+    for (size_t i = 0; i < size(); i++) {
+      if (asleep[i] || parent[i] != i || !island_rested[i])
+        continue;
+      size_t k = i;
+      do {
+        asleep[k] = 1;
+        fell_asleep.push_back(static_cast<uint32_t>(k));
+        awake--;
+        k = next[k];
+      } while (k != i);
+    }
+  }
+
+private:
+  std::vector<uint32_t> parent;
+  // Ring of the bodies of an island
+  std::vector<uint32_t> next;
+  std::vector<uint8_t> rested;
+  // Had a contact in this step
+  std::vector<uint8_t> touched;
+  // Steps in a row that a body started and ended at rest without contacts
+  std::vector<uint32_t> rest_steps;
+  std::vector<uint8_t> island_rested;
+  std::vector<uint8_t> asleep;
+  size_t awake = 0;
+  std::vector<uint32_t> fell_asleep;
+
+  static bool at_rest(const BodyBuffer &b, size_t i) {
+    return b.vx[i] == 0 && b.vy[i] == 0;
+  }
+
+  uint32_t find(size_t i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return static_cast<uint32_t>(i);
+  }
+};
+} // namespace ewdg
+#endif // BODY_ISLANDS_H_
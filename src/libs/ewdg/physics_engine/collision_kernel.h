@@ -0,0 +1,238 @@
+#ifndef COLLISION_KERNEL_H_
+#define COLLISION_KERNEL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "math/vector2.h"
+#include "physics_engine/body_buffer.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||            \
+    defined(_M_IX86)
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EWDG_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define EWDG_AVX2 1
+#define EWDG_TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#elif defined(__GNUC__) || defined(__clang__)
+#define EWDG_AVX2 1
+#define EWDG_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+#endif
+#endif
+
+namespace ewdg {
+// A candidate that overlaps the tested body and the repulsion force pushing
+// it away. The tested body receives the opposite force.
+struct Contact {
+  uint32_t body;
+  double fx, fy;
+};
+
+// Tests body i against count candidates and writes the overlapping ones to
+// out, in candidate order. Returns the number of contacts written, out must
+// have room for count contacts.
+using CollisionKernel = size_t (*)(const BodyBuffer &b, size_t i,
+                                   const uint32_t *candidates, size_t count,
+                                   float repulsion_force, Contact *out);
+
+inline size_t collide_scalar(const BodyBuffer &b, size_t i,
+                             const uint32_t *candidates, size_t count,
+                             float repulsion_force, Contact *out) {
+  size_t hits = 0;
+  for (size_t k = 0; k < count; k++) {
+    uint32_t j = candidates[k];
+    if (!b.overlaps(i, j))
+      continue;
+    Vector2 force_dir = Vector2(b.x[j] - b.x[i], b.y[j] - b.y[i]).normalize();
+    Vector2 force = force_dir * repulsion_force;
+    out[hits++] = {j, force.x, force.y};
+  }
+  return hits;
+}
+
+#ifdef EWDG_SSE2
+// The vector kernels evaluate Vector2::normalize (and its Q_rsqrt) with the
+// same operations in the same order, so their forces match the scalar kernel
+// bit for bit.
+inline __m128 q_rsqrt_ps(__m128 number) {
+  const __m128 x2 = _mm_mul_ps(number, _mm_set1_ps(0.5f));
+  __m128i i = _mm_castps_si128(number);
+  i = _mm_sub_epi32(_mm_set1_epi32(0x5f3759df), _mm_srli_epi32(i, 1));
+  __m128 y = _mm_castsi128_ps(i);
+  __m128 t = _mm_mul_ps(_mm_mul_ps(x2, y), y);
+  return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), t));
+}
+
+inline size_t collide_sse2(const BodyBuffer &b, size_t i,
+                           const uint32_t *candidates, size_t count,
+                           float repulsion_force, Contact *out) {
+  const __m128d xi = _mm_set1_pd(b.x[i]);
+  const __m128d yi = _mm_set1_pd(b.y[i]);
+  const __m128d min_xi = _mm_set1_pd(b.x[i] - b.half_width[i]);
+  const __m128d max_xi = _mm_set1_pd(b.x[i] + b.half_width[i]);
+  const __m128d min_yi = _mm_set1_pd(b.y[i] - b.half_height[i]);
+  const __m128d max_yi = _mm_set1_pd(b.y[i] + b.half_height[i]);
+  const __m128d repulsion = _mm_set1_pd(repulsion_force);
+
+  size_t hits = 0;
+  size_t k = 0;
+  for (; k + 2 <= count; k += 2) {
+    uint32_t j0 = candidates[k], j1 = candidates[k + 1];
+    __m128d xj = _mm_set_pd(b.x[j1], b.x[j0]);
+    __m128d yj = _mm_set_pd(b.y[j1], b.y[j0]);
+    __m128d hwj = _mm_set_pd(b.half_width[j1], b.half_width[j0]);
+    __m128d hhj = _mm_set_pd(b.half_height[j1], b.half_height[j0]);
+
+    __m128d separated = _mm_or_pd(
+        _mm_or_pd(_mm_cmplt_pd(max_xi, _mm_sub_pd(xj, hwj)),
+                  _mm_cmpgt_pd(min_xi, _mm_add_pd(xj, hwj))),
+        _mm_or_pd(_mm_cmplt_pd(max_yi, _mm_sub_pd(yj, hhj)),
+                  _mm_cmpgt_pd(min_yi, _mm_add_pd(yj, hhj))));
+    int mask = ~_mm_movemask_pd(separated) & 0x3;
+    if (!mask)
+      continue;
+
+    __m128d dx = _mm_sub_pd(xj, xi);
+    __m128d dy = _mm_sub_pd(yj, yi);
+    __m128 mag = _mm_cvtpd_ps(
+        _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+    __m128d inv_mag = _mm_cvtps_pd(q_rsqrt_ps(mag));
+    __m128d nonzero = _mm_cmpneq_pd(_mm_cvtps_pd(mag), _mm_setzero_pd());
+    __m128d fx = _mm_mul_pd(_mm_and_pd(_mm_mul_pd(dx, inv_mag), nonzero),
+                            repulsion);
+    __m128d fy = _mm_mul_pd(_mm_and_pd(_mm_mul_pd(dy, inv_mag), nonzero),
+                            repulsion);
+
+    double fxs[2], fys[2];
+    _mm_storeu_pd(fxs, fx);
+    _mm_storeu_pd(fys, fy);
+    if (mask & 1)
+      out[hits++] = {j0, fxs[0], fys[0]};
+    if (mask & 2)
+      out[hits++] = {j1, fxs[1], fys[1]};
+  }
+  return hits + collide_scalar(b, i, candidates + k, count - k,
+                               repulsion_force, out + hits);
+}
+
+#ifdef EWDG_AVX2
+EWDG_TARGET_AVX2 inline size_t collide_avx2(const BodyBuffer &b, size_t i,
+                                            const uint32_t *candidates,
+                                            size_t count,
+                                            float repulsion_force,
+                                            Contact *out) {
+  const __m256d xi = _mm256_set1_pd(b.x[i]);
+  const __m256d yi = _mm256_set1_pd(b.y[i]);
+  const __m256d min_xi = _mm256_set1_pd(b.x[i] - b.half_width[i]);
+  const __m256d max_xi = _mm256_set1_pd(b.x[i] + b.half_width[i]);
+  const __m256d min_yi = _mm256_set1_pd(b.y[i] - b.half_height[i]);
+  const __m256d max_yi = _mm256_set1_pd(b.y[i] + b.half_height[i]);
+  const __m256d repulsion = _mm256_set1_pd(repulsion_force);
+
+  // Masked gathers from zero, the unmasked form leaves GCC warning about an
+  // uninitialized source register
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+  size_t hits = 0;
+  size_t k = 0;
+  for (; k + 4 <= count; k += 4) {
+    __m128i idx =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(candidates + k));
+    __m256d xj = _mm256_mask_i32gather_pd(zero, b.x.data(), idx, all, 8);
+    __m256d yj = _mm256_mask_i32gather_pd(zero, b.y.data(), idx, all, 8);
+    __m256d hwj =
+        _mm256_mask_i32gather_pd(zero, b.half_width.data(), idx, all, 8);
+    __m256d hhj =
+        _mm256_mask_i32gather_pd(zero, b.half_height.data(), idx, all, 8);
+
+    __m256d separated = _mm256_or_pd(
+        _mm256_or_pd(
+            _mm256_cmp_pd(max_xi, _mm256_sub_pd(xj, hwj), _CMP_LT_OQ),
+            _mm256_cmp_pd(min_xi, _mm256_add_pd(xj, hwj), _CMP_GT_OQ)),
+        _mm256_or_pd(
+            _mm256_cmp_pd(max_yi, _mm256_sub_pd(yj, hhj), _CMP_LT_OQ),
+            _mm256_cmp_pd(min_yi, _mm256_add_pd(yj, hhj), _CMP_GT_OQ)));
+    int mask = ~_mm256_movemask_pd(separated) & 0xf;
+    if (!mask)
+      continue;
+
+    __m256d dx = _mm256_sub_pd(xj, xi);
+    __m256d dy = _mm256_sub_pd(yj, yi);
+    __m128 mag = _mm256_cvtpd_ps(
+        _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+    __m256d inv_mag = _mm256_cvtps_pd(q_rsqrt_ps(mag));
+    __m256d nonzero = _mm256_cmp_pd(_mm256_cvtps_pd(mag),
+                                    _mm256_setzero_pd(), _CMP_NEQ_OQ);
+    __m256d fx = _mm256_mul_pd(
+        _mm256_and_pd(_mm256_mul_pd(dx, inv_mag), nonzero), repulsion);
+    __m256d fy = _mm256_mul_pd(
+        _mm256_and_pd(_mm256_mul_pd(dy, inv_mag), nonzero), repulsion);
+
+    double fxs[4], fys[4];
+    _mm256_storeu_pd(fxs, fx);
+    _mm256_storeu_pd(fys, fy);
+    for (int lane = 0; lane < 4; lane++) {
+      if (mask & (1 << lane))
+        out[hits++] = {candidates[k + lane], fxs[lane], fys[lane]};
+    }
+  }
+  return hits + collide_scalar(b, i, candidates + k, count - k,
+                               repulsion_force, out + hits);
+}
+
+inline bool cpu_has_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return false;
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool avx = (info[2] & (1 << 28)) != 0;
+  if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+    return false;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // EWDG_AVX2
+#endif // EWDG_SSE2
+
+// Picks the widest kernel the CPU supports, checked once at first use
+inline CollisionKernel best_collision_kernel() {
+  static const CollisionKernel kernel = []() -> CollisionKernel {
+#ifdef EWDG_AVX2
+    if (cpu_has_avx2())
+      return collide_avx2;
+#endif
+#ifdef EWDG_SSE2
+    return collide_sse2;
+#else
+    return collide_scalar;
+#endif
+  }();
+  return kernel;
+}
+
+inline const char *collision_kernel_name(CollisionKernel kernel) {
+#ifdef EWDG_AVX2
+  if (kernel == collide_avx2)
+    return "avx2";
+#endif
+#ifdef EWDG_SSE2
+  if (kernel == collide_sse2)
+    return "sse2";
+#endif
+  return "scalar";
+}
+} // namespace ewdg
+#endif // COLLISION_KERNEL_H_
@@ -0,0 +1,177 @@
+#ifndef SPATIAL_HASH_H_
+#define SPATIAL_HASH_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "math/vector2.h"
+
+namespace ewdg {
+// Uniform grid broadphase. Bodies are bucketed by the cells their bounding
+// box covers and only bodies sharing a cell are reported as candidates.
+class SpatialHash {
+public:
+  // bounds(i, min, max) fills in the bounding box of body i. When cell_size
+  // is <= 0 the largest body extent is used so that every body covers at most
+  // 2x2 cells.
+  template <typename Bounds>
+  void build(size_t count, Bounds bounds, double cell_size = 0.0) {
+    build(count, bounds, [](size_t) { return true; }, cell_size);
+  }
+
+  // Only buckets the bodies for which bucketed(i) is true, so only those are
+  // reported. Every body can still be queried.
+  template <typename Bounds, typename Filter>
+  void build(size_t count, Bounds bounds, Filter bucketed,
+             double cell_size = 0.0) {
+    body_min.resize(count);
+    body_max.resize(count);
+    double largest = 0.0;
+    for (size_t i = 0; i < count; i++) {
+      bounds(i, body_min[i], body_max[i]);
+      largest = std::max(largest, body_max[i].x - body_min[i].x);
+      largest = std::max(largest, body_max[i].y - body_min[i].y);
+    }
+    cell = cell_size > 0.0 ? cell_size : std::max(largest, 1e-3);
+
+    entries.clear();
+    for (size_t i = 0; i < count; i++) {
+      if (!bucketed(i))
+        continue;
+      CellRange r = cell_range(i);
+      for (int64_t cy = r.min_y; cy <= r.max_y; cy++) {
+        for (int64_t cx = r.min_x; cx <= r.max_x; cx++) {
+          entries.push_back({cell_key(cx, cy), static_cast<uint32_t>(i)});
+        }
+      }
+    }
+    std::sort(entries.begin(), entries.end());
+    sorted_entries = entries.size();
+  }
+
+  // Collects every body j > i that shares at least one cell with body i, in
+  // ascending order and without duplicates.
+  void query(uint32_t i, std::vector<uint32_t> &out) const {
+    collect(cell_range(i), i + 1, out);
+  }
+
+  // Buckets body i, covering min to max, in a built hash. Call
+  // sort_inserted before the next query, a whole batch is merged at once.
+  void insert(uint32_t i, const Vector2 &min, const Vector2 &max) {
+    CellRange r = cell_range(min, max);
+    for (int64_t cy = r.min_y; cy <= r.max_y; cy++) {
+      for (int64_t cx = r.min_x; cx <= r.max_x; cx++) {
+        entries.push_back({cell_key(cx, cy), i});
+      }
+    }
+  }
+
+  void sort_inserted() {
+    auto middle = entries.begin() + sorted_entries;
+    std::sort(middle, entries.end());
+    // std::inplace_merge would allocate a buffer on every call
+    merged.resize(entries.size());
+    std::merge(entries.begin(), middle, middle, entries.end(),
+               merged.begin());
+    entries.swap(merged);
+    sorted_entries = entries.size();
+  }
+
+  // Collects every bucketed body that shares at least one cell with the box
+  // from min to max, in ascending order and without duplicates.
+  void query_box(const Vector2 &min, const Vector2 &max,
+                 std::vector<uint32_t> &out) const {
+    collect(cell_range(min, max), 0, out);
+  }
+
+  double cell_size() const { return cell; }
+
+private:
+  struct Entry {
+    uint64_t key;
+    uint32_t body;
+    bool operator<(const Entry &other) const {
+      return key != other.key ? key < other.key : body < other.body;
+    }
+  };
+  struct CellRange {
+    int64_t min_x, min_y, max_x, max_y;
+  };
+
+  double cell = 1.0;
+  std::vector<Vector2> body_min;
+  std::vector<Vector2> body_max;
+  std::vector<Entry> entries;
+  std::vector<Entry> merged;
+  // entries from here on were inserted after the last sort
+  size_t sorted_entries = 0;
+
+  // Collects the bodies >= first in the cells of r, in ascending order and
+  // without duplicates. The bodies of a cell are sorted, so up to four
+  // cells, all a body covers with the default cell size, are merged
+  // instead of sorted.
+  void collect(const CellRange &r, uint32_t first,
+               std::vector<uint32_t> &out) const {
+    using Run = std::pair<std::vector<Entry>::const_iterator,
+                          std::vector<Entry>::const_iterator>;
+    Run runs[4];
+    size_t run_count = 0;
+    bool merge = (r.max_x - r.min_x + 1) * (r.max_y - r.min_y + 1) <= 4;
+    out.clear();
+    for (int64_t cy = r.min_y; cy <= r.max_y; cy++) {
+      for (int64_t cx = r.min_x; cx <= r.max_x; cx++) {
+        uint64_t key = cell_key(cx, cy);
+        auto it = std::lower_bound(entries.begin(), entries.end(),
+                                   Entry{key, first});
+        auto end = it;
+        while (end != entries.end() && end->key == key)
+          ++end;
+        if (merge) {
+          if (it != end)
+            runs[run_count++] = {it, end};
+        } else {
+          for (; it != end; ++it) {
+            out.push_back(it->body);
+          }
+        }
+      }
+    }
+    if (!merge) {
+      std::sort(out.begin(), out.end());
+      out.erase(std::unique(out.begin(), out.end()), out.end());
+      return;
+    }
+    while (run_count > 0) {
+      size_t lowest = 0;
+      for (size_t k = 1; k < run_count; k++) {
+        if (runs[k].first->body < runs[lowest].first->body)
+          lowest = k;
+      }
+      uint32_t body = runs[lowest].first->body;
+      if (out.empty() || out.back() != body)
+        out.push_back(body);
+      if (++runs[lowest].first == runs[lowest].second)
+        runs[lowest] = runs[--run_count];
+    }
+  }
+
+  CellRange cell_range(size_t i) const {
+    return cell_range(body_min[i], body_max[i]);
+  }
+
+  CellRange cell_range(const Vector2 &min, const Vector2 &max) const {
+    return {static_cast<int64_t>(std::floor(min.x / cell)),
+            static_cast<int64_t>(std::floor(min.y / cell)),
+            static_cast<int64_t>(std::floor(max.x / cell)),
+            static_cast<int64_t>(std::floor(max.y / cell))};
+  }
+
+  static uint64_t cell_key(int64_t cx, int64_t cy) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) |
+           static_cast<uint32_t>(cy);
+  }
+};
+} // namespace ewdg
+#endif // SPATIAL_HASH_H_
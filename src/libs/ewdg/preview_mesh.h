@@ -0,0 +1,126 @@
+#ifndef PREVIEW_MESH_H_
+#define PREVIEW_MESH_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "math/vector2.h"
+#include "math/vector3.h"
+#include "mesh_sink.h"
+#include "room.h"
+
+namespace ewdg {
+// Room mesh for live previews of the separation simulation. The rooms'
+// topology does not change while they move, so the mesh is built once and
+// afterwards only the vertices of rooms that moved are rewritten in place.
+class PreviewMesh {
+public:
+  std::vector<Vector3> vertices;
+  std::vector<int32_t> indices;
+
+  // Rebuilds the whole mesh, indices included
+  void build(const std::vector<Room> &rooms) {
+    vertices.clear();
+    indices.clear();
+    room_offsets.clear();
+    positions.clear();
+    size_t vertex_total = 0, index_total = 0;
+    for (const Room &r : rooms) {
+      std::pair<size_t, size_t> size = r.mesh_size();
+      vertex_total += size.first;
+      index_total += size.second;
+    }
+    vertices.reserve(vertex_total);
+    indices.reserve(index_total);
+    VectorSink sink(vertices, indices);
+    for (const Room &r : rooms) {
+      room_offsets.push_back(vertices.size());
+      positions.push_back(r.position);
+      r.generate_3d_mesh(sink);
+    }
+    room_offsets.push_back(vertices.size());
+    dirty.clear();
+    if (!vertices.empty())
+      dirty.push_back({0, vertices.size()});
+    const double inf = std::numeric_limits<double>::infinity();
+    bounds_min = Vector3(inf, inf, inf);
+    bounds_max = Vector3(-inf, -inf, -inf);
+    grow_bounds(vertices.begin(), vertices.end());
+  }
+
+  // True if the rooms still have the topology the mesh was built with
+  bool matches(const std::vector<Room> &rooms) const {
+    if (rooms.size() + 1 != room_offsets.size())
+      return false;
+    for (size_t i = 0; i < rooms.size(); i++) {
+      if (!rooms[i].entrance_points.empty())
+        return false;
+    }
+    return true;
+  }
+
+  // Rewrites the vertices of every room whose position changed since the
+  // last build or update. Returns the changed vertex ranges as (first vertex,
+  // vertex count), adjacent rooms are merged into one range.
+  const std::vector<std::pair<size_t, size_t>> &
+  update(const std::vector<Room> &rooms) {
+    dirty.clear();
+    for (size_t i = 0; i < rooms.size(); i++) {
+      const Vector2 &p = rooms[i].position;
+      if (p.x == positions[i].x && p.y == positions[i].y)
+        continue;
+      positions[i] = p;
+
+      room_vertices.clear();
+      room_indices.clear();
+      VectorSink sink(room_vertices, room_indices);
+      rooms[i].generate_3d_mesh(sink);
+      size_t first = room_offsets[i];
+      std::copy(room_vertices.begin(), room_vertices.end(),
+                vertices.begin() + first);
+      grow_bounds(room_vertices.begin(), room_vertices.end());
+
+      if (!dirty.empty() &&
+          dirty.back().first + dirty.back().second == first) {
+        dirty.back().second += room_vertices.size();
+      } else {
+        dirty.push_back({first, room_vertices.size()});
+      }
+    }
+    return dirty;
+  }
+
+  // Axis aligned bounds as (min, max) of every vertex written since the
+  // last build. They are grown while the moved rooms are rewritten and
+  // never shrink, so they may be looser than the current vertices.
+  std::pair<Vector3, Vector3> bounds() const {
+    return {bounds_min, bounds_max};
+  }
+
+private:
+  std::vector<size_t> room_offsets;
+  std::vector<Vector2> positions;
+  std::vector<std::pair<size_t, size_t>> dirty;
+  std::vector<Vector3> room_vertices;
+  std::vector<int32_t> room_indices;
+  Vector3 bounds_min;
+  Vector3 bounds_max;
+
+  template <typename It> void grow_bounds(It first, It last) {
+    for (; first != last; ++first) {
+      const Vector3 &v = *first;
+      bounds_min = Vector3(std::min(bounds_min.x, v.x),
+                           std::min(bounds_min.y, v.y),
+                           std::min(bounds_min.z, v.z));
+      bounds_max = Vector3(std::max(bounds_max.x, v.x),
+                           std::max(bounds_max.y, v.y),
+                           std::max(bounds_max.z, v.z));
+    }
+  }
+};
+} // namespace ewdg
+#endif // PREVIEW_MESH_H_
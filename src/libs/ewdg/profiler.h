@@ -0,0 +1,112 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef EWDG_PROFILING
+#include <chrono>
+#endif
+
+namespace ewdg {
+// Generation stages timed by Profiler
+enum ProfileStage : uint32_t {
+  STAGE_GENERATE_ROOMS,
+  STAGE_SIMULATE_ROOMS,
+  STAGE_TRIANGULATION,
+  STAGE_LAYOUT,
+  STAGE_GENERATE_PATHS,
+  STAGE_GENERATE_MESH,
+  PROFILE_STAGE_COUNT
+};
+
+enum ProfileCounter : uint32_t {
+  COUNTER_PHYSICS_STEPS,
+  COUNTER_PAIRS_TESTED,
+  COUNTER_CONTACTS,
+  COUNTER_AWAKE_BODIES,
+  COUNTER_DELAUNAY_EDGES,
+  COUNTER_MST_EDGES,
+  COUNTER_LAYOUT_EDGES,
+  COUNTER_PATHS,
+  COUNTER_MESH_VERTICES,
+  COUNTER_MESH_INDICES,
+  PROFILE_COUNTER_COUNT
+};
+
+// Stage times and counters collected since the last reset
+struct Profile {
+  double stage_ms[PROFILE_STAGE_COUNT] = {};
+  uint64_t counters[PROFILE_COUNTER_COUNT] = {};
+
+  static const char *stage_name(ProfileStage s) {
+    static const char *names[PROFILE_STAGE_COUNT] = {
+        "generate_rooms", "simulate_rooms", "triangulation",
+        "layout",         "generate_paths", "generate_mesh"};
+    return names[s];
+  }
+
+  static const char *counter_name(ProfileCounter c) {
+    static const char *names[PROFILE_COUNTER_COUNT] = {
+        "physics_steps", "pairs_tested",  "contacts",
+        "awake_bodies",  "delaunay_edges", "mst_edges",
+        "layout_edges",  "paths",          "mesh_vertices",
+        "mesh_indices"};
+    return names[c];
+  }
+};
+
+// Scoped stage timers and counters. Only collects when EWDG_PROFILING is
+// defined, otherwise every call is an empty inline function and profile()
+// stays zero.
+class Profiler {
+public:
+#ifdef EWDG_PROFILING
+  static constexpr bool enabled = true;
+
+  // Adds the time until it goes out of scope to a stage
+  class Scope {
+  public:
+    Scope(Profiler &profiler, ProfileStage stage)
+        : profiler(profiler), stage(stage),
+          start(std::chrono::steady_clock::now()) {}
+    ~Scope() {
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      profiler.data.stage_ms[stage] += elapsed.count();
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    Profiler &profiler;
+    ProfileStage stage;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  void add(ProfileCounter c, uint64_t value = 1) { data.counters[c] += value; }
+  void set(ProfileCounter c, uint64_t value) { data.counters[c] = value; }
+  void reset() { data = Profile(); }
+  const Profile &profile() const { return data; }
+
+private:
+  Profile data;
+#else
+  static constexpr bool enabled = false;
+
+  class Scope {
+  public:
+    Scope(Profiler &, ProfileStage) {}
+  };
+
+  void add(ProfileCounter, uint64_t = 1) {}
+  void set(ProfileCounter, uint64_t) {}
+  void reset() {}
+  const Profile &profile() const {
+    static const Profile empty;
+    return empty;
+  }
+#endif
+};
+} // namespace ewdg
+#endif // PROFILER_H_
@@ -2,10 +2,15 @@
 #define ROOM_H_
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <utility>
 #include <vector>
 
 #include "math/vector2.h"
 #include "math/vector3.h"
+#include "mesh_sink.h"
 #include "physics_engine/rect.h"
 
 namespace ewdg {
@@ -13,8 +18,14 @@ class Room : public Rect {
 public:
   double floor_to_ceiling = 3.0f;
 
+  // Sorted by wall, then by distance from the wall's start. Walls are
+  // numbered clockwise from the top one, each starts at the corner of the
+  // same number in generate_3d_mesh. Use add_entrance and remove_entrance so
+  // wall_entrances_end stays in sync.
   std::vector<Vector2> entrance_points;
   double entrance_width;
+  // The entrances of wall w end at entrance_points[wall_entrances_end[w]]
+  uint32_t wall_entrances_end[4] = {};
 
   Room(const Vector2 &position, float width, float height)
       : Rect(width, height, position) {}
@@ -22,120 +33,174 @@ public:
 
   void generate_3d_mesh(std::vector<Vector3> &vertices,
                         std::vector<int32_t> &indices) const {
-    const std::vector<int> surfaceIndices = {0, 1, 2, 0, 2, 3};
+    VectorSink sink(vertices, indices);
+    generate_3d_mesh(sink);
+  }
+
+  // Adds an entrance at p, a point on one of the walls. It goes to the
+  // nearest wall, after the entrances of that wall it does not come before.
+  void add_entrance(const Vector2 &p) {
+    int wall = nearest_wall(p);
+    double offset = wall_offset(wall, p);
+    uint32_t first = wall > 0 ? wall_entrances_end[wall - 1] : 0;
+    uint32_t at = first;
+    while (at < wall_entrances_end[wall] &&
+           wall_offset(wall, entrance_points[at]) <= offset)
+      at++;
+    entrance_points.insert(entrance_points.begin() + at, p);
+    for (int w = wall; w < 4; w++) {
+      wall_entrances_end[w]++;
+    }
+  }
+
+  // Removes the entrance at p, returns false if there is none
+  bool remove_entrance(const Vector2 &p) {
+    auto it = std::find(entrance_points.begin(), entrance_points.end(), p);
+    if (it == entrance_points.end())
+      return false;
+    uint32_t at = static_cast<uint32_t>(it - entrance_points.begin());
+    entrance_points.erase(it);
+    for (int w = 0; w < 4; w++) {
+      if (wall_entrances_end[w] > at)
+        wall_entrances_end[w]--;
+    }
+    return true;
+  }
+
+  void clear_entrances() {
+    entrance_points.clear();
+    std::fill(std::begin(wall_entrances_end), std::end(wall_entrances_end), 0);
+  }
+
+  template <typename Sink> void generate_3d_mesh(Sink &sink) const {
+    static constexpr int surfaceIndices[6] = {0, 1, 2, 0, 2, 3};
 
     // Get the corners of the room in 3D space
-    Vector3 corners[4] = {
+    const Vector3 floorVertices[4] = {
         Vector3(get_topleft_corner().x, 0.0f, get_topleft_corner().y),
         Vector3(get_topright_corner().x, 0.0f, get_topright_corner().y),
         Vector3(get_bottomright_corner().x, 0.0f, get_bottomright_corner().y),
         Vector3(get_bottomleft_corner().x, 0.0f, get_bottomleft_corner().y)};
 
-    // Create vertices for the floor and ceiling
-    std::vector<Vector3> floorVertices;
-    std::vector<Vector3> ceilingVertices;
-
+    Vector3 ceilingVertices[4];
     for (int i = 0; i < 4; ++i) {
-      floorVertices.push_back(corners[i]);
-      ceilingVertices.push_back(corners[i] +
-                                Vector3(0.0f, floor_to_ceiling, 0.0f));
+      ceilingVertices[i] =
+          floorVertices[i] + Vector3(0.0f, floor_to_ceiling, 0.0f);
     }
 
-    int baseIndex = vertices.size();
+    auto add_vertex = [&](const Vector3 &v) { sink.add_vertex(v.x, v.y, v.z); };
+
+    int baseIndex = sink.vertex_count();
     // Push floor vertices and indices to form triangles
     for (const auto &vertex : floorVertices) {
-      vertices.push_back(vertex);
+      add_vertex(vertex);
     }
 
     for (const auto &index : surfaceIndices) {
-      indices.push_back(baseIndex + index);
+      sink.add_index(baseIndex + index);
     }
 
-    baseIndex = vertices.size();
+    baseIndex = sink.vertex_count();
 
     // Push ceiling vertices and indices to form triangles
     for (const auto &vertex : ceilingVertices) {
-      vertices.push_back(vertex);
+      add_vertex(vertex);
     }
 
-    for (auto it = surfaceIndices.rbegin(); it != surfaceIndices.rend(); ++it) {
-      indices.push_back(baseIndex + *it);
+    for (int k = 5; k >= 0; --k) {
+      sink.add_index(baseIndex + surfaceIndices[k]);
     }
-    baseIndex = vertices.size();
+    baseIndex = sink.vertex_count();
 
     for (int i = 0; i < 4; ++i) {
       int next = (i + 1) % 4;
       Vector2 wallStart = {floorVertices[i].x, floorVertices[i].z};
       Vector2 wallEnd = {floorVertices[next].x, floorVertices[next].z};
 
-      vertices.push_back(floorVertices[i]);
-      vertices.push_back(ceilingVertices[i]);
+      add_vertex(floorVertices[i]);
+      add_vertex(ceilingVertices[i]);
 
       Vector2 lineDirection = (wallEnd - wallStart).normalize();
-      Vector2 wallDirection = lineDirection.perpendicular();
 
       // TODO: Handle paths not direcly connecting to rooms (paths that pass
       // though rooms before reaching their destinaction)
       // TODO: Handle overlapping entrances
-      //  Check for entrance points along the wall
-      // Sort entrance points based on their distance from the wall start
-      std::vector<Vector2> sorted_entrance_points =
-          entrance_points; // Copy the original vector
-
-      // Sort the copied vector
-      std::sort(sorted_entrance_points.begin(), sorted_entrance_points.end(),
-                [&](const Vector2 &a, const Vector2 &b) {
-                  double distanceA = (wallStart - a).length();
-                  double distanceB = (wallStart - b).length();
-                  return distanceA < distanceB;
-                });
-      for (const auto &entrancePoint : sorted_entrance_points) {
-        // Calculate distance from the wall start to the entrance point along
-        // the wall direction
-        double distance = (wallStart - entrancePoint).length();
-
-        // If entrance point is along this wall segment
-        if (Vector2::is_point_on_line(wallStart, wallEnd, entrancePoint)) {
-
-          // Calculate vertices for the opening
-          Vector2 openingStart =
-              wallStart +
-              lineDirection *
-                  ((wallStart - entrancePoint).length() - entrance_width / 2);
-          Vector2 openingEnd = openingStart + lineDirection * entrance_width;
-
-          // Add the opening vertices
-          vertices.push_back({openingStart.x, 0.0f, openingStart.y});
-          vertices.push_back(
-              {openingStart.x, floor_to_ceiling, openingStart.y});
-
-          vertices.push_back({openingEnd.x, 0.0f, openingEnd.y});
-          vertices.push_back({openingEnd.x, floor_to_ceiling, openingEnd.y});
-
-          for (const auto &index : {0, 1, 2, 1, 3, 2}) {
-            indices.push_back(baseIndex + index);
-          }
-          // Move the base indeces in preperation for next wall segment
-          baseIndex += 4;
+      // The entrances of the wall, already sorted from its start
+      for (uint32_t e = i > 0 ? wall_entrances_end[i - 1] : 0;
+           e < wall_entrances_end[i]; e++) {
+        const Vector2 &entrancePoint = entrance_points[e];
+        // Calculate vertices for the opening
+        Vector2 openingStart =
+            wallStart +
+            lineDirection *
+                ((wallStart - entrancePoint).length() - entrance_width / 2);
+        Vector2 openingEnd = openingStart + lineDirection * entrance_width;
+
+        // Add the opening vertices
+        sink.add_vertex(openingStart.x, 0.0f, openingStart.y);
+        sink.add_vertex(openingStart.x, floor_to_ceiling, openingStart.y);
+
+        sink.add_vertex(openingEnd.x, 0.0f, openingEnd.y);
+        sink.add_vertex(openingEnd.x, floor_to_ceiling, openingEnd.y);
+
+        for (const auto &index : {0, 1, 2, 1, 3, 2}) {
+          sink.add_index(baseIndex + index);
         }
+        // Move the base indeces in preperation for next wall segment
+        baseIndex += 4;
       }
 
       // Fill in the rest of the wall
-      vertices.push_back(floorVertices[next]);
-      vertices.push_back(ceilingVertices[next]);
+      add_vertex(floorVertices[next]);
+      add_vertex(ceilingVertices[next]);
 
       for (const auto &index : {0, 1, 2, 1, 3, 2}) {
-        indices.push_back(baseIndex + index);
+        sink.add_index(baseIndex + index);
       }
       // Move the base indeces in preperation for next wall segment
-      baseIndex = vertices.size();
+      baseIndex = sink.vertex_count();
     }
   }
+
+  // Number of vertices and indices generate_3d_mesh produces
+  std::pair<size_t, size_t> mesh_size() const {
+    size_t openings = entrance_points.size();
+    // Floor and ceiling, then four walls split into one quad per opening
+    return {8 + 4 * 4 + 4 * openings, 12 + 4 * 6 + 6 * openings};
+  }
+
   bool operator==(const Room &other) const {
     return (position == other.position && width == other.width &&
             height == other.height &&
             floor_to_ceiling == other.floor_to_ceiling);
   }
+
+private:
+  // Wall whose line p is closest to
+  int nearest_wall(const Vector2 &p) const {
+    double half_w = width / 2, half_h = height / 2;
+    double distance[4] = {std::abs(p.y - (position.y - half_h)),
+                          std::abs(p.x - (position.x + half_w)),
+                          std::abs(p.y - (position.y + half_h)),
+                          std::abs(p.x - (position.x - half_w))};
+    return static_cast<int>(std::min_element(distance, distance + 4) -
+                            distance);
+  }
+
+  // Distance of p from the start of the wall, along the wall
+  double wall_offset(int wall, const Vector2 &p) const {
+    double half_w = width / 2, half_h = height / 2;
+    switch (wall) {
+    case 0:
+      return p.x - (position.x - half_w);
+    case 1:
+      return p.y - (position.y - half_h);
+    case 2:
+      return position.x + half_w - p.x;
+    default:
+      return position.y + half_h - p.y;
+    }
+  }
 };
 } // namespace ewdg
 namespace std {
@@ -0,0 +1,309 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ewdg {
+// Chase-Lev work-stealing deque of task pointers. Only the owning worker
+// pushes and pops, at the bottom, other workers steal from the top. Nothing
+// takes a lock, only a pop of the last task and steals race for it through
+// a compare-exchange on top. The ring grows when full, retired rings stay
+// alive until the deque is destroyed because a thief may still read one.
+template <typename T> class WorkStealingDeque {
+public:
+  WorkStealingDeque() {
+    rings.push_back(std::make_unique<Ring>(INITIAL_CAPACITY));
+    ring.store(rings.back().get(), std::memory_order_relaxed);
+  }
+
+  // Owner only
+  void push(T *item) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Ring *r = ring.load(std::memory_order_relaxed);
+    if (b - t >= static_cast<int64_t>(r->capacity))
+      r = grow(r, t, b);
+    r->put(b, item);
+    bottom.store(b + 1, std::memory_order_seq_cst);
+  }
+
+  // Owner only, newest first. nullptr when empty or a thief took the last
+  // task.
+  T *pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Ring *r = ring.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_seq_cst);
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T *item = r->get(b);
+    if (t == b) {
+      // Last task, race the thieves for it
+      if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed))
+        item = nullptr;
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // Any thread, oldest first. nullptr when empty or another thread won the
+  // race for the task.
+  T *steal() {
+    int64_t t = top.load(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_seq_cst);
+    if (t >= b)
+      return nullptr;
+    T *item = ring.load(std::memory_order_acquire)->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed))
+      return nullptr;
+    return item;
+  }
+
+private:
+  static constexpr size_t INITIAL_CAPACITY = 64;
+
+  struct Ring {
+    size_t capacity;
+    std::unique_ptr<std::atomic<T *>[]> slots;
+
+    explicit Ring(size_t capacity)
+        : capacity(capacity), slots(new std::atomic<T *>[capacity]) {}
+    T *get(int64_t i) const {
+      return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+    }
+    void put(int64_t i, T *item) {
+      slots[i & (capacity - 1)].store(item, std::memory_order_relaxed);
+    }
+  };
+
+  std::atomic<int64_t> top{0};
+  std::atomic<int64_t> bottom{0};
+  std::atomic<Ring *> ring{nullptr};
+  // Owner only, the current ring and every retired one
+  std::vector<std::unique_ptr<Ring>> rings;
+
+  Ring *grow(Ring *old, int64_t t, int64_t b) {
+    rings.push_back(std::make_unique<Ring>(old->capacity * 2));
+    Ring *r = rings.back().get();
+    for (int64_t i = t; i < b; i++) {
+      r->put(i, old->get(i));
+    }
+    ring.store(r, std::memory_order_release);
+    return r;
+  }
+};
+
+// Work-stealing thread pool. Every worker owns a WorkStealingDeque, tasks
+// submitted from a worker go to the bottom of its own deque and are popped
+// LIFO without locking, idle workers steal FIFO from the top of the other
+// deques. Tasks submitted from other threads go through a shared injection
+// queue. The pending count is atomic, the sleep mutex is only taken by
+// workers that found nothing to run and by submitters that have to wake one.
+class ThreadPool {
+public:
+  static constexpr size_t NOT_A_WORKER = static_cast<size_t>(-1);
+
+  explicit ThreadPool(size_t thread_count = 0) {
+    if (thread_count == 0)
+      thread_count = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < thread_count; i++) {
+      queues.push_back(std::make_unique<WorkStealingDeque<Task>>());
+    }
+    for (size_t i = 0; i < thread_count; i++) {
+      workers.emplace_back([this, i] { worker_loop(i); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return workers.size(); }
+
+  // Index of the calling worker in [0, size()), or NOT_A_WORKER when called
+  // from a thread that does not belong to this pool.
+  size_t worker_index() const {
+    return current_pool() == this ? current_index() : NOT_A_WORKER;
+  }
+
+  void execute(std::function<void()> task) {
+    Task *t = new Task(std::move(task));
+    size_t index = worker_index();
+    if (index == NOT_A_WORKER) {
+      std::lock_guard<std::mutex> lock(injected_mutex);
+      injected.push_back(t);
+      injected_count.fetch_add(1, std::memory_order_release);
+    } else {
+      queues[index]->push(t);
+    }
+    // Pairs with the sleeping worker's increment of sleepers followed by
+    // its check of pending, one of the two sees the other
+    pending.fetch_add(1, std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_seq_cst) > 0) {
+      // A worker between its check and its wait holds the mutex
+      { std::lock_guard<std::mutex> lock(sleep_mutex); }
+      wake.notify_one();
+    }
+  }
+
+  template <typename F>
+  std::future<typename std::invoke_result<F>::type> submit(F &&f) {
+    using R = typename std::invoke_result<F>::type;
+    auto task =
+        std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    std::future<R> result = task->get_future();
+    execute([task] { (*task)(); });
+    return result;
+  }
+
+  // Runs fn(begin, end) over [0, count) in chunks of at most grain items and
+  // returns once every chunk is done. The calling thread works through the
+  // chunks too, so this cannot deadlock when called from a worker: once it
+  // runs out of chunks to claim, every chunk is running somewhere and it
+  // sleeps until the last one finishes.
+  void parallel_for(size_t count, size_t grain,
+                    const std::function<void(size_t, size_t)> &fn) {
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = (count + grain - 1) / grain;
+    if (chunks <= 1) {
+      if (count > 0)
+        fn(0, count);
+      return;
+    }
+
+    // Helpers that only start after every chunk was claimed return without
+    // touching fn, which may be gone by then.
+    struct Shared {
+      std::atomic<size_t> next{0};
+      std::atomic<size_t> done{0};
+      std::mutex mutex;
+      std::condition_variable finished;
+    };
+    auto shared = std::make_shared<Shared>();
+    const std::function<void(size_t, size_t)> *body = &fn;
+    auto run = [shared, body, count, grain, chunks] {
+      size_t chunk;
+      while ((chunk = shared->next.fetch_add(1)) < chunks) {
+        (*body)(chunk * grain, std::min(count, (chunk + 1) * grain));
+        if (shared->done.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+            chunks) {
+          std::lock_guard<std::mutex> lock(shared->mutex);
+          shared->finished.notify_one();
+        }
+      }
+    };
+    size_t helpers = std::min(chunks - 1, size());
+    for (size_t i = 0; i < helpers; i++) {
+      execute(run);
+    }
+    run();
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->finished.wait(lock, [&] {
+      return shared->done.load(std::memory_order_acquire) == chunks;
+    });
+  }
+
+private:
+  using Task = std::function<void()>;
+
+  std::vector<std::unique_ptr<WorkStealingDeque<Task>>> queues;
+  std::vector<std::thread> workers;
+
+  std::mutex injected_mutex;
+  std::deque<Task *> injected;
+  // Lets workers skip the injection queue's mutex while it is empty
+  std::atomic<size_t> injected_count{0};
+
+  // Queued tasks no worker has taken yet. A task is counted after it is
+  // queued and uncounted after it is taken, so the count can dip below zero
+  // for a moment.
+  std::atomic<int64_t> pending{0};
+  std::atomic<size_t> sleepers{0};
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+
+  static const ThreadPool *&current_pool() {
+    static thread_local const ThreadPool *pool = nullptr;
+    return pool;
+  }
+
+  static size_t &current_index() {
+    static thread_local size_t index = NOT_A_WORKER;
+    return index;
+  }
+
+  Task *pop_task(size_t index) {
+    if (Task *task = queues[index]->pop())
+      return task;
+    if (injected_count.load(std::memory_order_acquire) > 0) {
+      std::lock_guard<std::mutex> lock(injected_mutex);
+      if (!injected.empty()) {
+        Task *task = injected.front();
+        injected.pop_front();
+        injected_count.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+      }
+    }
+    for (size_t k = 1; k < queues.size(); k++) {
+      if (Task *task = queues[(index + k) % queues.size()]->steal())
+        return task;
+    }
+    return nullptr;
+  }
+
+  void worker_loop(size_t index) {
+    current_pool() = this;
+    current_index() = index;
+    while (true) {
+      if (Task *task = pop_task(index)) {
+        pending.fetch_sub(1, std::memory_order_seq_cst);
+        std::unique_ptr<Task> owned(task);
+        (*owned)();
+        continue;
+      }
+      // A task was queued but not found, e.g. a steal lost a race
+      if (pending.load(std::memory_order_seq_cst) > 0) {
+        std::this_thread::yield();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      sleepers.fetch_add(1, std::memory_order_seq_cst);
+      wake.wait(lock, [this] {
+        return stopping || pending.load(std::memory_order_seq_cst) > 0;
+      });
+      sleepers.fetch_sub(1, std::memory_order_relaxed);
+      if (stopping && pending.load(std::memory_order_seq_cst) <= 0)
+        return; // Stopping and nothing left to run
+    }
+  }
+};
+} // namespace ewdg
+#endif // THREAD_POOL_H_
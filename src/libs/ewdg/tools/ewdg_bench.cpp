@@ -0,0 +1,1158 @@
+// Headless dungeon generator and benchmark.
+//
+// Runs the full ewdg pipeline without Godot and reports how long each stage
+// takes. Build with `scons bench`, see --help for the options. The modes
+// that check one implementation against another print "(mismatch)" and exit
+// with a failure status when they disagree, so CI can run them.
+
+#include "chunked_world.h"
+#include "dungeon_file.h"
+#include "ewdg.h"
+#include "generation_service.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Counts the allocations of --alloc-bench, the other modes only pay for a
+// relaxed load per allocation
+static std::atomic<bool> counting_allocations{false};
+static std::atomic<size_t> allocation_count{0};
+
+void *operator new(size_t size) {
+  if (counting_allocations.load(std::memory_order_relaxed))
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+// The sized and array forms go through the plain pair, so every delete
+// releases memory from the matching new. The plain delete stays out of line,
+// otherwise GCC sees free() on memory from new in the callers.
+#if defined(__GNUC__) || defined(__clang__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+BENCH_NOINLINE void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { ::operator delete(p); }
+void *operator new[](size_t size) { return ::operator new(size); }
+void operator delete[](void *p) noexcept { ::operator delete(p); }
+void operator delete[](void *p, size_t) noexcept { ::operator delete(p); }
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  uint64_t seed = 0;
+  int dungeons = 10;
+  int rooms = 150;
+  int main_rooms = 25;
+  int extra_paths = 10;
+  float min_width = 5.0f;
+  float max_width = 20.0f;
+  double bounds_x = 50.0;
+  double bounds_y = 50.0;
+  float repulsion_force = 1.0f;
+  float friction_force = 0.5f;
+  float timestep = 0.1f;
+  bool brute_force = false;
+  bool scalar = false;
+  bool sleep = false;
+  bool parallel_simulation = false;
+  ewdg::SimulationSolver solver = ewdg::SOLVER_FORCES;
+  double relaxation = 1.9;
+  size_t max_steps = 0;
+  double energy_threshold = 0.0;
+  bool route_corridors = false;
+  bool spatial_order = false;
+  bool union_mesh = false;
+  int threads = 0;
+  bool kernel_bench = false;
+  bool mst_bench = false;
+  bool paths_bench = false;
+  bool step_bench = false;
+  bool solver_bench = false;
+  bool alloc_bench = false;
+  bool file_bench = false;
+  bool chunk_bench = false;
+  bool delaunay_bench = false;
+};
+
+enum Stage {
+  GENERATE_ROOMS,
+  SIMULATE_ROOMS,
+  MAKE_GRAF_LAYOUT,
+  GENERATE_PATHS,
+  GENERATE_MESH,
+  STAGE_COUNT
+};
+
+const char *stage_names[STAGE_COUNT] = {"generate_rooms", "simulate_rooms",
+                                        "make_graf_layout", "generate_paths",
+                                        "generate_mesh"};
+
+void print_usage(const char *program) {
+  std::printf(
+      "Usage: %s [options]\n"
+      "  --seed N           Seed of the first dungeon (default 0)\n"
+      "  --dungeons N       Number of dungeons to generate (default 10)\n"
+      "  --rooms N          Rooms per dungeon (default 150)\n"
+      "  --main-rooms N     Main rooms per dungeon (default 25)\n"
+      "  --extra-paths N    Extra non-MST paths (default 10)\n"
+      "  --min-width F      Minimum room width (default 5)\n"
+      "  --max-width F      Maximum room width (default 20)\n"
+      "  --bounds WxH       Room placement bounds (default 50x50)\n"
+      "  --repulsion F      Repulsion force (default 1)\n"
+      "  --friction F       Friction force (default 0.5)\n"
+      "  --timestep F       Simulation timestep (default 0.1)\n"
+      "  --brute-force      Disable the collision broadphase\n"
+      "  --scalar           Disable the SIMD collision kernels\n"
+      "  --sleep            Put rooms that came to rest to sleep, from 512\n"
+      "                     rooms on\n"
+      "  --parallel-sim     Use the parallel simulation step, on --threads\n"
+      "                     workers with --step-bench\n"
+      "  --solver NAME      Separation solver, forces or positions (default\n"
+      "                     forces)\n"
+      "  --relaxation F     Overlap removed per sweep by the positions solver\n"
+      "                     (default 1.9)\n"
+      "  --max-steps N      Simulation step limit, 0 for none (default 0)\n"
+      "  --energy F         End the simulation once no rooms overlap and the\n"
+      "                     kinetic energy is below F (default 0, off)\n"
+      "  --route-corridors  Route corridors around rooms with A*\n"
+      "  --union-mesh       Mesh the union of the floor plans\n"
+      "  --spatial-order    Keep the rooms in Morton order\n"
+      "  --threads N        Generate the batch on N worker threads through\n"
+      "                     GenerationService, reports throughput only\n"
+      "  --kernel-bench     Time the scalar and SIMD collision kernels on the\n"
+      "                     rooms of one dungeon instead\n"
+      "  --mst-bench        Time edge sorting and the minimum spanning tree\n"
+      "                     builders on 10k and 100k random points instead,\n"
+      "                     Boruvka runs on --threads workers\n"
+      "  --paths-bench      Time serial and parallel path planning on\n"
+      "                     Delaunay layouts of 10k and 100k rooms instead,\n"
+      "                     parallel runs on --threads workers\n"
+      "  --step-bench       Time the sequential and the parallel simulation\n"
+      "                     step of one dungeon of --rooms rooms on 1 to 32\n"
+      "                     threads, for --max-steps steps (default 20)\n"
+      "  --solver-bench     Compare the forces and positions solvers on\n"
+      "                     --dungeons dungeons instead\n"
+      "  --alloc-bench      Count the allocations of --dungeons dungeons\n"
+      "                     generated one after another on one Dungeon\n"
+      "  --file-bench       Write --dungeons dungeons to a dungeon file, map\n"
+      "                     them back and compare every section\n"
+      "  --chunk-bench      Walk a viewer across a chunked world of tiles of\n"
+      "                     --rooms rooms and check the resident tiles\n"
+      "  --delaunay-bench   Check the sweep-hull triangulation against the\n"
+      "                     brute force one on small random point sets\n",
+      program);
+}
+
+bool parse_options(int argc, char **argv, Options &o) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&]() -> const char * {
+      if (i + 1 >= argc) {
+        std::fprintf(stderr, "Missing value for %s\n", arg.c_str());
+        std::exit(1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--seed") {
+      o.seed = std::strtoull(value(), nullptr, 10);
+    } else if (arg == "--dungeons") {
+      o.dungeons = std::atoi(value());
+    } else if (arg == "--rooms") {
+      o.rooms = std::atoi(value());
+    } else if (arg == "--main-rooms") {
+      o.main_rooms = std::atoi(value());
+    } else if (arg == "--extra-paths") {
+      o.extra_paths = std::atoi(value());
+    } else if (arg == "--min-width") {
+      o.min_width = std::atof(value());
+    } else if (arg == "--max-width") {
+      o.max_width = std::atof(value());
+    } else if (arg == "--bounds") {
+      if (std::sscanf(value(), "%lfx%lf", &o.bounds_x, &o.bounds_y) != 2) {
+        std::fprintf(stderr, "--bounds expects WxH, e.g. 50x50\n");
+        return false;
+      }
+    } else if (arg == "--repulsion") {
+      o.repulsion_force = std::atof(value());
+    } else if (arg == "--friction") {
+      o.friction_force = std::atof(value());
+    } else if (arg == "--timestep") {
+      o.timestep = std::atof(value());
+    } else if (arg == "--brute-force") {
+      o.brute_force = true;
+    } else if (arg == "--scalar") {
+      o.scalar = true;
+    } else if (arg == "--sleep") {
+      o.sleep = true;
+    } else if (arg == "--parallel-sim") {
+      o.parallel_simulation = true;
+    } else if (arg == "--solver") {
+      std::string name = value();
+      if (name == "forces") {
+        o.solver = ewdg::SOLVER_FORCES;
+      } else if (name == "positions") {
+        o.solver = ewdg::SOLVER_POSITIONS;
+      } else {
+        std::fprintf(stderr, "--solver expects forces or positions\n");
+        return false;
+      }
+    } else if (arg == "--relaxation") {
+      o.relaxation = std::atof(value());
+    } else if (arg == "--max-steps") {
+      o.max_steps = std::strtoull(value(), nullptr, 10);
+    } else if (arg == "--energy") {
+      o.energy_threshold = std::atof(value());
+    } else if (arg == "--route-corridors") {
+      o.route_corridors = true;
+    } else if (arg == "--union-mesh") {
+      o.union_mesh = true;
+    } else if (arg == "--spatial-order") {
+      o.spatial_order = true;
+    } else if (arg == "--kernel-bench") {
+      o.kernel_bench = true;
+    } else if (arg == "--mst-bench") {
+      o.mst_bench = true;
+    } else if (arg == "--paths-bench") {
+      o.paths_bench = true;
+    } else if (arg == "--step-bench") {
+      o.step_bench = true;
+    } else if (arg == "--solver-bench") {
+      o.solver_bench = true;
+    } else if (arg == "--alloc-bench") {
+      o.alloc_bench = true;
+    } else if (arg == "--file-bench") {
+      o.file_bench = true;
+    } else if (arg == "--chunk-bench") {
+      o.chunk_bench = true;
+    } else if (arg == "--delaunay-bench") {
+      o.delaunay_bench = true;
+    } else if (arg == "--threads") {
+      o.threads = std::atoi(value());
+    } else if (arg == "--help" || arg == "-h") {
+      print_usage(argv[0]);
+      std::exit(0);
+    } else {
+      std::fprintf(stderr, "Unknown option %s\n", arg.c_str());
+      print_usage(argv[0]);
+      return false;
+    }
+  }
+  return o.dungeons > 0;
+}
+
+// FNV-1a over the mesh so layout regressions show up as a changed checksum
+uint64_t hash_mesh(const std::vector<ewdg::Vector3> &vertices,
+                   const std::vector<int32_t> &indices) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  auto mix = [&](const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+  };
+  for (const ewdg::Vector3 &v : vertices) {
+    float xyz[3] = {static_cast<float>(v.x), static_cast<float>(v.y),
+                    static_cast<float>(v.z)};
+    mix(xyz, sizeof(xyz));
+  }
+  mix(indices.data(), indices.size() * sizeof(int32_t));
+  return hash;
+}
+
+// Times one collision kernel over the given candidate lists, returns the
+// nanoseconds per candidate test and the number of contacts found.
+double time_kernel(ewdg::CollisionKernel kernel, const ewdg::BodyBuffer &b,
+                   const std::vector<std::vector<uint32_t>> &candidates,
+                   size_t &contact_count) {
+  std::vector<ewdg::Contact> contacts(b.size());
+  size_t tests = 0;
+  int repeats = 0;
+  double elapsed = 0;
+  Clock::time_point start = Clock::now();
+  do {
+    contact_count = 0;
+    for (size_t i = 0; i < candidates.size(); i++) {
+      contact_count += kernel(b, i, candidates[i].data(), candidates[i].size(),
+                              1.0f, contacts.data());
+      tests += candidates[i].size();
+    }
+    repeats++;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (elapsed < 0.25 || repeats < 3);
+  return elapsed * 1e9 / tests;
+}
+
+// Collision kernel microbenchmark on the unseparated rooms of one dungeon,
+// once with the broadphase candidate lists and once with all pairs.
+int run_kernel_bench(const Options &o) {
+  ewdg::Dungeon d(o.seed);
+  d.dungeon_bounds = ewdg::Vector2(o.bounds_x, o.bounds_y);
+  d.generate_rooms(o.rooms, o.min_width, o.max_width);
+  ewdg::BodyBuffer b;
+  b.load(d.rooms);
+
+  ewdg::SpatialHash hash;
+  hash.build(b.size(), [&](size_t i, ewdg::Vector2 &min, ewdg::Vector2 &max) {
+    min = b.min_corner(i);
+    max = b.max_corner(i);
+  });
+  std::vector<std::vector<uint32_t>> broadphase(b.size());
+  std::vector<std::vector<uint32_t>> all_pairs(b.size());
+  for (size_t i = 0; i < b.size(); i++) {
+    hash.query(i, broadphase[i]);
+    for (size_t j = i + 1; j < b.size(); j++) {
+      all_pairs[i].push_back(j);
+    }
+  }
+
+  ewdg::CollisionKernel simd = ewdg::best_collision_kernel();
+  std::printf("rooms: %d  bounds: %gx%g  seed: %llu  simd kernel: %s\n\n",
+              o.rooms, o.bounds_x, o.bounds_y,
+              static_cast<unsigned long long>(o.seed),
+              ewdg::collision_kernel_name(simd));
+  std::printf("%-12s %14s %14s %10s %10s\n", "candidates", "scalar ns/test",
+              "simd ns/test", "speedup", "contacts");
+  bool failed = false;
+  for (auto &lists : {std::make_pair("broadphase", &broadphase),
+                      std::make_pair("all pairs", &all_pairs)}) {
+    size_t scalar_contacts = 0, simd_contacts = 0;
+    double scalar_ns =
+        time_kernel(ewdg::collide_scalar, b, *lists.second, scalar_contacts);
+    double simd_ns = time_kernel(simd, b, *lists.second, simd_contacts);
+    std::printf("%-12s %14.3f %14.3f %9.2fx %10zu%s\n", lists.first,
+                scalar_ns, simd_ns, scalar_ns / simd_ns, simd_contacts,
+                scalar_contacts == simd_contacts ? "" : "  (mismatch)");
+    failed |= scalar_contacts != simd_contacts;
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Runs fn until at least a quarter second has passed and returns the mean
+// milliseconds per run
+template <typename F> double time_repeated(F &&fn) {
+  int repeats = 0;
+  double elapsed = 0;
+  Clock::time_point start = Clock::now();
+  do {
+    fn();
+    repeats++;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (elapsed < 0.25 || repeats < 3);
+  return elapsed * 1e3 / repeats;
+}
+
+// Edge sort and minimum spanning tree microbenchmark on the Delaunay
+// triangulation of uniformly random points.
+int run_mst_bench(const Options &o) {
+  ewdg::ThreadPool pool(o.threads);
+  std::printf("seed: %llu  boruvka threads: %zu\n\n",
+              static_cast<unsigned long long>(o.seed), pool.size());
+  std::printf("%-9s %9s %12s %12s %12s %12s\n", "vertices", "edges",
+              "std::sort ms", "radix ms", "kruskal ms", "boruvka ms");
+  bool failed = false;
+  for (int n : {10000, 100000}) {
+    ewdg::Random rng(o.seed);
+    std::vector<ewdg::Room> points;
+    for (int i = 0; i < n; i++) {
+      points.push_back(ewdg::Room(ewdg::Vector2(rng.next_float(0, 1000),
+                                                rng.next_float(0, 1000)),
+                                  1, 1));
+    }
+    ewdg::DelaunayTriangulation<ewdg::Room> delaunay;
+    delaunay.generate_graf(points);
+    const ewdg::Graph &graph = delaunay.graph;
+
+    // Sort the edges in triangulation order again, as finalize would
+    std::vector<ewdg::GraphEdge> shuffled = graph.edges;
+    for (size_t i = shuffled.size(); i > 1; i--) {
+      std::swap(shuffled[i - 1], shuffled[rng.next_int(0, i - 1)]);
+    }
+    std::vector<ewdg::GraphEdge> sorted;
+    double std_sort_ms = time_repeated([&] {
+      sorted = shuffled;
+      std::sort(sorted.begin(), sorted.end());
+    });
+    ewdg::Graph radix;
+    radix.vertex_count = graph.vertex_count;
+    double radix_ms = time_repeated([&] {
+      radix.edges = shuffled;
+      radix.sort_edges();
+    });
+
+    ewdg::MinimumSpanningTree mst;
+    ewdg::Graph kruskal, boruvka;
+    double kruskal_ms = time_repeated([&] { mst.kruskal(graph, kruskal); });
+    double boruvka_ms =
+        time_repeated([&] { mst.boruvka(graph, boruvka, pool); });
+
+    bool same = radix.edges.size() == sorted.size() &&
+                kruskal.edges.size() == boruvka.edges.size();
+    for (size_t i = 0; same && i < sorted.size(); i++) {
+      same = radix.edges[i].from == sorted[i].from &&
+             radix.edges[i].to == sorted[i].to;
+    }
+    for (size_t i = 0; same && i < kruskal.edges.size(); i++) {
+      same = kruskal.edges[i] == boruvka.edges[i];
+    }
+    std::printf("%-9d %9zu %12.3f %12.3f %12.3f %12.3f%s\n", n, graph.size(),
+                std_sort_ms, radix_ms, kruskal_ms, boruvka_ms,
+                same ? "" : "  (mismatch)");
+    failed |= !same;
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Edges of a triangulation as sorted (from, to) pairs
+std::vector<std::pair<uint32_t, uint32_t>> edge_set(const ewdg::Graph &graph) {
+  std::vector<std::pair<uint32_t, uint32_t>> edges;
+  for (const ewdg::GraphEdge &e : graph.edges) {
+    edges.push_back({e.from, e.to});
+  }
+  std::sort(edges.begin(), edges.end());
+  return edges;
+}
+
+// The O(n^4) brute force triangulation is the oracle for the sweep-hull.
+// Both run on the same random point sets, which have no four co-circular
+// points, so their edge sets have to be equal.
+int run_delaunay_bench(const Options &o) {
+  const int sets = 200;
+  std::printf("seed: %llu  sets per size: %d\n\n",
+              static_cast<unsigned long long>(o.seed), sets);
+  std::printf("%-9s %12s %12s %12s\n", "points", "sweep us", "brute us",
+              "mismatches");
+  ewdg::Random rng(o.seed);
+  ewdg::DelaunayTriangulation<ewdg::Room> sweep, brute;
+  bool failed = false;
+  for (int n : {3, 4, 8, 16, 32, 64}) {
+    double sweep_us = 0, brute_us = 0;
+    int mismatches = 0;
+    for (int s = 0; s < sets; s++) {
+      std::vector<ewdg::Room> points;
+      for (int i = 0; i < n; i++) {
+        points.push_back(ewdg::Room(ewdg::Vector2(rng.next_float(0, 100),
+                                                  rng.next_float(0, 100)),
+                                    1, 1));
+      }
+      Clock::time_point start = Clock::now();
+      sweep.generate_graf(points);
+      Clock::time_point swept = Clock::now();
+      brute.brutforce_graf(points);
+      Clock::time_point end = Clock::now();
+      sweep_us +=
+          std::chrono::duration<double, std::micro>(swept - start).count();
+      brute_us +=
+          std::chrono::duration<double, std::micro>(end - swept).count();
+      mismatches += edge_set(sweep.graph) != edge_set(brute.graph);
+    }
+    std::printf("%-9d %12.3f %12.3f %12d%s\n", n, sweep_us / sets,
+                brute_us / sets, mismatches,
+                mismatches == 0 ? "" : "  (mismatch)");
+    failed |= mismatches != 0;
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// generate_paths with and without a pool on layouts far larger than a
+// simulated dungeon's. Rooms sit on a jittered grid so they never overlap.
+int run_paths_bench(const Options &o) {
+  ewdg::ThreadPool pool(o.threads);
+  std::printf("seed: %llu  threads: %zu\n\n",
+              static_cast<unsigned long long>(o.seed), pool.size());
+  std::printf("%-9s %9s %12s %12s\n", "rooms", "paths", "serial ms",
+              "parallel ms");
+  bool failed = false;
+  for (int n : {10000, 100000}) {
+    ewdg::Random rng(o.seed);
+    ewdg::Dungeon d;
+    int side = static_cast<int>(std::ceil(std::sqrt(n)));
+    for (int i = 0; i < n; i++) {
+      ewdg::Vector2 cell(i % side * 30.0f, i / side * 30.0f);
+      ewdg::Vector2 jitter(rng.next_float(-5, 5), rng.next_float(-5, 5));
+      d.main_rooms.push_back(ewdg::Room(cell + jitter,
+                                        rng.next_float(5, 20),
+                                        rng.next_float(5, 20)));
+    }
+    d.delaunay.generate_graf(d.main_rooms);
+    d.dungeon_layout = d.delaunay.graph;
+
+    auto run = [&](ewdg::ThreadPool *p) {
+      d.paths.clear();
+      for (ewdg::Room &r : d.main_rooms) {
+        r.clear_entrances();
+      }
+      d.generate_paths(p);
+    };
+    double serial_ms = time_repeated([&] { run(nullptr); });
+    std::vector<ewdg::Room> serial_rooms = d.main_rooms;
+    std::vector<ewdg::Path> serial_paths = d.paths;
+    double parallel_ms = time_repeated([&] { run(&pool); });
+
+    // Vector2's operator== has a tolerance, the results must be identical
+    auto identical = [](const ewdg::Vector2 &a, const ewdg::Vector2 &b) {
+      return a.x == b.x && a.y == b.y;
+    };
+    bool same = serial_paths.size() == d.paths.size();
+    for (size_t i = 0; same && i < d.paths.size(); i++) {
+      same = identical(serial_paths[i].start, d.paths[i].start) &&
+             identical(serial_paths[i].end, d.paths[i].end) &&
+             identical(serial_paths[i].intersektion, d.paths[i].intersektion);
+    }
+    for (size_t i = 0; same && i < d.main_rooms.size(); i++) {
+      const std::vector<ewdg::Vector2> &a = serial_rooms[i].entrance_points;
+      const std::vector<ewdg::Vector2> &b = d.main_rooms[i].entrance_points;
+      same = a.size() == b.size() && std::equal(a.begin(), a.end(),
+                                                b.begin(), identical);
+    }
+    std::printf("%-9d %9zu %12.3f %12.3f%s\n", n, d.paths.size(), serial_ms,
+                parallel_ms, same ? "" : "  (mismatch)");
+    failed |= !same;
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Hashes the exact room positions
+uint64_t hash_rooms(const std::vector<ewdg::Room> &rooms) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (const ewdg::Room &r : rooms) {
+    double xy[2] = {r.position.x, r.position.y};
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(xy);
+    for (size_t i = 0; i < sizeof(xy); i++) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+  }
+  return hash;
+}
+
+int run_step_bench(const Options &o) {
+  size_t steps = o.max_steps > 0 ? o.max_steps : 20;
+  std::printf("rooms: %d  bounds: %gx%g  steps: %zu  seed: %llu\n\n",
+              o.rooms, o.bounds_x, o.bounds_y, steps,
+              static_cast<unsigned long long>(o.seed));
+  std::printf("%-10s %12s %9s %18s\n", "threads", "ms/step", "speedup",
+              "positions");
+  // Runs the simulation for the given number of steps and returns the time
+  // per step, threads == 0 uses the sequential step
+  auto run = [&](size_t threads, uint64_t &hash) {
+    ewdg::ThreadPool pool(std::max<size_t>(threads, 1));
+    ewdg::Dungeon d(o.seed);
+    d.dungeon_bounds = ewdg::Vector2(o.bounds_x, o.bounds_y);
+    d.use_broadphase = !o.brute_force;
+    d.use_simd = !o.scalar;
+    d.parallel_simulation = threads > 0;
+    d.max_simulation_steps = steps;
+    d.generate_rooms(o.rooms, o.min_width, o.max_width);
+
+    Clock::time_point start = Clock::now();
+    d.simulate_rooms(o.repulsion_force, o.friction_force, o.timestep, &pool);
+    double ms =
+        std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    hash = hash_rooms(d.rooms);
+    return ms / d.simulation_stats().steps;
+  };
+  uint64_t sequential_hash;
+  double sequential_ms = run(0, sequential_hash);
+  std::printf("%-10s %12.3f %8.2fx   %016llx\n", "sequential", sequential_ms,
+              1.0, static_cast<unsigned long long>(sequential_hash));
+  bool failed = false;
+  for (size_t threads : {1, 2, 4, 8, 16, 32}) {
+    uint64_t hash;
+    double ms = run(threads, hash);
+    std::printf("%-10zu %12.3f %8.2fx   %016llx%s\n", threads, ms,
+                sequential_ms / ms, static_cast<unsigned long long>(hash),
+                hash == sequential_hash ? "" : "  (mismatch)");
+    failed |= hash != sequential_hash;
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Room pairs whose interiors overlap
+size_t count_overlaps(const std::vector<ewdg::Room> &rooms) {
+  size_t overlaps = 0;
+  for (size_t i = 0; i < rooms.size(); i++) {
+    for (size_t j = i + 1; j < rooms.size(); j++) {
+      const ewdg::Room &a = rooms[i], &b = rooms[j];
+      overlaps += a.position.x - a.width / 2 < b.position.x + b.width / 2 &&
+                  b.position.x - b.width / 2 < a.position.x + a.width / 2 &&
+                  a.position.y - a.height / 2 < b.position.y + b.height / 2 &&
+                  b.position.y - b.height / 2 < a.position.y + a.height / 2;
+    }
+  }
+  return overlaps;
+}
+
+// Side of a square with the area of the rooms' bounding box
+double layout_extent(const std::vector<ewdg::Room> &rooms) {
+  double min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+  for (size_t i = 0; i < rooms.size(); i++) {
+    const ewdg::Room &r = rooms[i];
+    double x0 = r.position.x - r.width / 2, x1 = r.position.x + r.width / 2;
+    double y0 = r.position.y - r.height / 2, y1 = r.position.y + r.height / 2;
+    min_x = i == 0 ? x0 : std::min(min_x, x0);
+    max_x = i == 0 ? x1 : std::max(max_x, x1);
+    min_y = i == 0 ? y0 : std::min(min_y, y0);
+    max_y = i == 0 ? y1 : std::max(max_y, y1);
+  }
+  return std::sqrt((max_x - min_x) * (max_y - min_y));
+}
+
+int run_solver_bench(const Options &o) {
+  std::printf("dungeons: %d  rooms: %d  bounds: %gx%g  seed: %llu  "
+              "relaxation: %g\n\n",
+              o.dungeons, o.rooms, o.bounds_x, o.bounds_y,
+              static_cast<unsigned long long>(o.seed), o.relaxation);
+  std::printf("%-10s %10s %10s %10s %12s %10s %10s\n", "solver", "mean ms",
+              "mean steps", "max steps", "step limited", "overlaps",
+              "extent");
+  const char *names[] = {"forces", "positions"};
+  for (ewdg::SimulationSolver solver :
+       {ewdg::SOLVER_FORCES, ewdg::SOLVER_POSITIONS}) {
+    double total_ms = 0;
+    size_t steps = 0, max_steps = 0, overlaps = 0;
+    double extent = 0;
+    int step_limited = 0;
+    for (int n = 0; n < o.dungeons; n++) {
+      ewdg::Dungeon d(o.seed + n);
+      d.dungeon_bounds = ewdg::Vector2(o.bounds_x, o.bounds_y);
+      d.use_broadphase = !o.brute_force;
+      d.use_simd = !o.scalar;
+      d.solver = solver;
+      d.solver_relaxation = o.relaxation;
+      d.max_simulation_steps = o.max_steps;
+      d.simulation_energy_threshold = o.energy_threshold;
+      d.generate_rooms(o.rooms, o.min_width, o.max_width);
+
+      Clock::time_point start = Clock::now();
+      d.simulate_rooms(o.repulsion_force, o.friction_force, o.timestep);
+      total_ms += std::chrono::duration<double, std::milli>(Clock::now() -
+                                                            start)
+                      .count();
+      const ewdg::SimulationStats &stats = d.simulation_stats();
+      steps += stats.steps;
+      max_steps = std::max(max_steps, stats.steps);
+      step_limited += stats.end == ewdg::SIMULATION_STEP_LIMIT;
+      overlaps += count_overlaps(d.rooms);
+      extent += layout_extent(d.rooms);
+    }
+    std::printf("%-10s %10.3f %10zu %10zu %12d %10zu %10.1f\n",
+                names[solver], total_ms / o.dungeons, steps / o.dungeons,
+                max_steps, step_limited, overlaps, extent / o.dungeons);
+  }
+  return 0;
+}
+
+// Parameters of the dungeon with the given seed
+ewdg::DungeonParams dungeon_params(const Options &o, uint64_t seed) {
+  ewdg::DungeonParams p;
+  p.seed = seed;
+  p.room_count = o.rooms;
+  p.main_room_count = o.main_rooms;
+  p.extra_paths_count = o.extra_paths;
+  p.min_room_width = o.min_width;
+  p.max_room_width = o.max_width;
+  p.bounds = ewdg::Vector2(o.bounds_x, o.bounds_y);
+  p.repulsion_force = o.repulsion_force;
+  p.friction_force = o.friction_force;
+  p.simulation_timestep = o.timestep;
+  p.route_corridors = o.route_corridors;
+  p.spatial_order = o.spatial_order;
+  p.sleeping_rooms = o.sleep;
+  p.parallel_simulation = o.parallel_simulation;
+  p.solver = o.solver;
+  p.solver_relaxation = o.relaxation;
+  p.max_simulation_steps = o.max_steps;
+  p.simulation_energy_threshold = o.energy_threshold;
+  return p;
+}
+
+int run_threaded(const Options &o) {
+  std::vector<ewdg::DungeonParams> batch(o.dungeons);
+  for (int n = 0; n < o.dungeons; n++) {
+    batch[n] = dungeon_params(o, o.seed + n);
+  }
+
+  ewdg::GenerationService service(o.threads);
+  std::vector<ewdg::GeneratedDungeon> results;
+  Clock::time_point start = Clock::now();
+  service.generate(batch, results).get();
+  uint64_t checksum = 0;
+  for (int n = 0; n < o.dungeons; n++) {
+    checksum ^= hash_mesh(results[n].vertices, results[n].indices) + n;
+  }
+  double total_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+  std::printf("dungeons: %d  rooms: %d  main rooms: %d  bounds: %gx%g  "
+              "seed: %llu  threads: %zu\n\n",
+              o.dungeons, o.rooms, o.main_rooms, o.bounds_x, o.bounds_y,
+              static_cast<unsigned long long>(o.seed),
+              service.thread_count());
+  std::printf("checksum: %016llx\n", static_cast<unsigned long long>(checksum));
+  std::printf("total: %.3f s  throughput: %.2f dungeons/s\n", total_s,
+              o.dungeons / total_s);
+  return 0;
+}
+
+int run_alloc_bench(const Options &o) {
+  std::printf("dungeons: %d  rooms: %d  main rooms: %d  bounds: %gx%g  "
+              "seed: %llu\n\n",
+              o.dungeons, o.rooms, o.main_rooms, o.bounds_x, o.bounds_y,
+              static_cast<unsigned long long>(o.seed));
+  ewdg::Dungeon d;
+  d.use_broadphase = !o.brute_force;
+  d.use_simd = !o.scalar;
+  d.union_mesh = o.union_mesh;
+  ewdg::DungeonParams p = dungeon_params(o, o.seed);
+
+  // The mesh goes into buffers that are reused as well
+  std::vector<ewdg::Vector3> vertices;
+  std::vector<int32_t> indices;
+  size_t first = 0, warm = 0, warm_max = 0;
+  counting_allocations.store(true, std::memory_order_relaxed);
+  for (int n = 0; n < o.dungeons; n++) {
+    size_t before = allocation_count.load(std::memory_order_relaxed);
+    p.seed = o.seed + n;
+    d.generate(p);
+    vertices.clear();
+    indices.clear();
+    ewdg::VectorSink sink(vertices, indices);
+    d.generate_mesh(sink, true);
+    size_t count = allocation_count.load(std::memory_order_relaxed) - before;
+    if (n == 0) {
+      first = count;
+    } else {
+      warm += count;
+      warm_max = std::max(warm_max, count);
+    }
+  }
+  counting_allocations.store(false, std::memory_order_relaxed);
+  std::printf("allocations  first: %zu  warm mean: %.2f  warm max: %zu\n",
+              first, o.dungeons > 1 ? double(warm) / (o.dungeons - 1) : 0.0,
+              warm_max);
+  return 0;
+}
+
+bool same_point(const ewdg::FileVector2 &a, const ewdg::Vector2 &b) {
+  return a.x == b.x && a.y == b.y;
+}
+
+// Rooms and their entrances as read back from a dungeon file
+bool same_rooms(const ewdg::DungeonView &view,
+                ewdg::FileArray<ewdg::FileRoom> file_rooms,
+                const std::vector<ewdg::Room> &rooms) {
+  if (file_rooms.size() != rooms.size())
+    return false;
+  for (size_t i = 0; i < rooms.size(); i++) {
+    const ewdg::FileRoom &f = file_rooms[i];
+    const ewdg::Room &r = rooms[i];
+    if (f.x != r.position.x || f.y != r.position.y || f.width != r.width ||
+        f.height != r.height || f.floor_to_ceiling != r.floor_to_ceiling)
+      return false;
+    if (!r.entrance_points.empty() && f.entrance_width != r.entrance_width)
+      return false;
+    ewdg::FileArray<ewdg::FileVector2> entrances = view.entrances(f);
+    if (entrances.size() != r.entrance_points.size() ||
+        !std::equal(entrances.begin(), entrances.end(),
+                    r.entrance_points.begin(), same_point))
+      return false;
+  }
+  return true;
+}
+
+// Every section of a mapped dungeon file against the dungeon it was
+// written from
+bool same_dungeon(const ewdg::DungeonView &view, const ewdg::Dungeon &d,
+                  const std::vector<ewdg::Vector3> &vertices,
+                  const std::vector<int32_t> &indices) {
+  if (!same_rooms(view, view.rooms(), d.rooms) ||
+      !same_rooms(view, view.main_rooms(), d.main_rooms))
+    return false;
+
+  ewdg::FileArray<ewdg::FileEdge> edges = view.edges();
+  if (edges.size() != d.dungeon_layout.edges.size())
+    return false;
+  for (size_t i = 0; i < edges.size(); i++) {
+    const ewdg::GraphEdge &e = d.dungeon_layout.edges[i];
+    if (edges[i].from != e.from || edges[i].to != e.to ||
+        edges[i].weight != e.weight)
+      return false;
+  }
+
+  ewdg::FileArray<ewdg::FilePath> paths = view.paths();
+  if (paths.size() != d.paths.size())
+    return false;
+  for (size_t i = 0; i < paths.size(); i++) {
+    const ewdg::FilePath &f = paths[i];
+    const ewdg::Path &p = d.paths[i];
+    ewdg::FileArray<ewdg::FileVector2> waypoints = view.waypoints(f);
+    if (!same_point(f.start, p.start) || !same_point(f.end, p.end) ||
+        !same_point(f.intersection, p.intersektion) || f.width != p.width ||
+        f.floor_to_ceiling != p.floor_to_ceiling ||
+        f.straight != (p.straight_path ? 1u : 0u) ||
+        waypoints.size() != p.polyline.size() ||
+        !std::equal(waypoints.begin(), waypoints.end(), p.polyline.begin(),
+                    same_point))
+      return false;
+  }
+
+  ewdg::FileArray<ewdg::FileVertex> file_vertices = view.vertices();
+  if (file_vertices.size() != vertices.size())
+    return false;
+  for (size_t i = 0; i < vertices.size(); i++) {
+    const ewdg::FileVertex &f = file_vertices[i];
+    if (f.x != static_cast<float>(vertices[i].x) ||
+        f.y != static_cast<float>(vertices[i].y) ||
+        f.z != static_cast<float>(vertices[i].z))
+      return false;
+  }
+  ewdg::FileArray<int32_t> file_indices = view.indices();
+  return file_indices.size() == indices.size() &&
+         std::equal(file_indices.begin(), file_indices.end(),
+                    indices.begin());
+}
+
+// Round trip through the dungeon file format. Each dungeon is written to a
+// file in the working directory, mapped back and compared section by
+// section. A view of the file cut one byte short has to be refused.
+int run_file_bench(const Options &o) {
+  const char *file_name = "ewdg_bench.ewdg";
+  std::printf("dungeons: %d  rooms: %d  main rooms: %d  bounds: %gx%g  "
+              "seed: %llu\n\n",
+              o.dungeons, o.rooms, o.main_rooms, o.bounds_x, o.bounds_y,
+              static_cast<unsigned long long>(o.seed));
+  ewdg::Dungeon d;
+  d.use_broadphase = !o.brute_force;
+  d.use_simd = !o.scalar;
+  d.union_mesh = o.union_mesh;
+  double write_ms = 0, open_ms = 0;
+  uint64_t bytes = 0;
+  bool same = true;
+  for (int n = 0; n < o.dungeons; n++) {
+    d.generate(dungeon_params(o, o.seed + n));
+    auto mesh = d.generate_mesh(true);
+
+    Clock::time_point start = Clock::now();
+    {
+      std::ofstream out(file_name, std::ios::binary | std::ios::trunc);
+      same &= ewdg::write_dungeon(out, d.rooms, d.main_rooms, d.paths,
+                                  d.dungeon_layout, &mesh.first,
+                                  &mesh.second);
+    }
+    Clock::time_point written = Clock::now();
+    ewdg::MappedFile file;
+    ewdg::DungeonView view;
+    bool opened = file.open(file_name) && view.open(file.data(), file.size());
+    Clock::time_point mapped = Clock::now();
+    write_ms +=
+        std::chrono::duration<double, std::milli>(written - start).count();
+    open_ms +=
+        std::chrono::duration<double, std::milli>(mapped - written).count();
+    if (!opened) {
+      same = false;
+      continue;
+    }
+    bytes += view.header().file_size;
+    same &= same_dungeon(view, d, mesh.first, mesh.second);
+    ewdg::DungeonView truncated;
+    same &= !truncated.open(file.data(), file.size() - 1);
+  }
+  std::remove(file_name);
+  std::printf("mean bytes: %llu  mean write ms: %.3f  mean map ms: %.3f%s\n",
+              static_cast<unsigned long long>(bytes / o.dungeons),
+              write_ms / o.dungeons, open_ms / o.dungeons,
+              same ? "" : "  (mismatch)");
+  return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Hashes what a tile generates on its own, its stitch entrances aside
+uint64_t hash_tile(const ewdg::Tile &tile) {
+  uint64_t hash = hash_rooms(tile.rooms) ^ hash_rooms(tile.main_rooms);
+  for (const ewdg::Path &p : tile.paths) {
+    double xy[4] = {p.start.x, p.start.y, p.end.x, p.end.y};
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(xy);
+    for (size_t i = 0; i < sizeof(xy); i++) {
+      hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+  }
+  return hash;
+}
+
+// Every entrance lies on the wall it is sorted into, in order from the
+// wall's start, and the wall ranges cover entrance_points
+bool walls_consistent(const ewdg::Room &r) {
+  const ewdg::Vector2 corners[4] = {
+      r.get_topleft_corner(), r.get_topright_corner(),
+      r.get_bottomright_corner(), r.get_bottomleft_corner()};
+  if (r.wall_entrances_end[3] != r.entrance_points.size())
+    return false;
+  uint32_t first = 0;
+  for (int w = 0; w < 4; w++) {
+    uint32_t end = r.wall_entrances_end[w];
+    if (end < first)
+      return false;
+    double last = -1;
+    for (uint32_t e = first; e < end; e++) {
+      const ewdg::Vector2 &p = r.entrance_points[e];
+      if (!ewdg::Vector2::is_point_on_line(corners[w], corners[(w + 1) % 4],
+                                           p))
+        return false;
+      double offset = (p - corners[w]).length();
+      if (offset < last)
+        return false;
+      last = offset;
+    }
+    first = end;
+  }
+  return true;
+}
+
+// The main room entrances of a tile are exactly the ends of its own paths
+// and of the stitches that reach it, and the rooms' wall ranges still hold
+bool tile_consistent(const ewdg::ChunkedWorld &world, ewdg::TileCoord c) {
+  const ewdg::Tile &tile = *world.find_tile(c);
+  auto less = [](const ewdg::Vector2 &a, const ewdg::Vector2 &b) {
+    return a.x != b.x ? a.x < b.x : a.y < b.y;
+  };
+  std::vector<ewdg::Vector2> expected, found;
+  for (const ewdg::Path &p : tile.paths) {
+    expected.push_back(p.start);
+    expected.push_back(p.end);
+  }
+  for (const ewdg::TileStitch &s : world.stitches()) {
+    if (!world.find_tile(s.a) || !world.find_tile(s.b))
+      return false;
+    if (s.a == c || s.b == c) {
+      const ewdg::Vector2 &entrance = s.a == c ? s.path.start : s.path.end;
+      const ewdg::Room &room = tile.main_rooms[s.a == c ? s.room_a : s.room_b];
+      if (std::find(room.entrance_points.begin(), room.entrance_points.end(),
+                    entrance) == room.entrance_points.end())
+        return false;
+      expected.push_back(entrance);
+    }
+  }
+  for (const ewdg::Room &r : tile.main_rooms) {
+    if (!walls_consistent(r))
+      return false;
+    found.insert(found.end(), r.entrance_points.begin(),
+                 r.entrance_points.end());
+  }
+  std::sort(expected.begin(), expected.end(), less);
+  std::sort(found.begin(), found.end(), less);
+  return expected.size() == found.size() &&
+         std::equal(expected.begin(), expected.end(), found.begin(),
+                    [](const ewdg::Vector2 &a, const ewdg::Vector2 &b) {
+                      return a.x == b.x && a.y == b.y;
+                    });
+}
+
+// Walks a viewer around a loop of tiles and back to its start. After every
+// update at most max_active_tiles may stay resident, every resident tile
+// has to pass tile_consistent and predict its mesh size exactly, and a
+// regenerated tile has to match the one it replaced.
+int run_chunk_bench(const Options &o) {
+  ewdg::ChunkedWorldParams params;
+  params.seed = o.seed;
+  params.rooms = dungeon_params(o, 0);
+  params.max_active_tiles = 9;
+  ewdg::ChunkedWorld world(params);
+  double tile = params.tile_size;
+  std::printf("rooms per tile: %d  main rooms: %d  tile size: %g  "
+              "max tiles: %zu  seed: %llu\n\n",
+              o.rooms, o.main_rooms, tile, params.max_active_tiles,
+              static_cast<unsigned long long>(o.seed));
+
+  // Half a tile per update, 8 tiles right, 4 down and back again
+  std::vector<ewdg::Vector2> walk;
+  ewdg::Vector2 viewer = world.tile_center({0, 0});
+  const ewdg::Vector2 moves[4] = {{tile / 2, 0}, {0, tile / 2},
+                                  {-tile / 2, 0}, {0, -tile / 2}};
+  const int move_counts[4] = {16, 8, 16, 8};
+  walk.push_back(viewer);
+  for (int m = 0; m < 4; m++) {
+    for (int k = 0; k < move_counts[m]; k++) {
+      viewer = viewer + moves[m];
+      walk.push_back(viewer);
+    }
+  }
+
+  std::unordered_map<uint64_t, uint64_t> tile_hashes;
+  size_t generated = 0, evicted = 0, max_active = 0;
+  double update_ms = 0;
+  bool same = true;
+  for (const ewdg::Vector2 &position : walk) {
+    Clock::time_point start = Clock::now();
+    generated += world.update(position, tile);
+    update_ms +=
+        std::chrono::duration<double, std::milli>(Clock::now() - start)
+            .count();
+    evicted += world.evicted_tiles().size();
+    max_active = std::max(max_active, world.active_tile_count());
+    same &= world.active_tile_count() <= params.max_active_tiles;
+
+    for (ewdg::TileCoord c : world.generated_tiles()) {
+      uint64_t key = (uint64_t(static_cast<uint32_t>(c.y)) << 32) |
+                     static_cast<uint32_t>(c.x);
+      uint64_t hash = hash_tile(*world.find_tile(c));
+      auto seen = tile_hashes.emplace(key, hash);
+      same &= seen.first->second == hash;
+    }
+    for (ewdg::TileCoord c : world.active_tiles()) {
+      same &= tile_consistent(world, c);
+      ewdg::CountingSink counted;
+      world.generate_tile_mesh(c, counted);
+      std::pair<size_t, size_t> size = world.tile_mesh_size(c);
+      same &= counted.vertices == size.first && counted.indices == size.second;
+    }
+  }
+  std::printf("updates: %zu  generated: %zu  regenerated: %zu  evicted: %zu  "
+              "max active: %zu\n",
+              walk.size(), generated, generated - tile_hashes.size(), evicted,
+              max_active);
+  std::printf("mean update ms: %.3f%s\n", update_ms / walk.size(),
+              same ? "" : "  (mismatch)");
+  return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  Options o;
+  if (!parse_options(argc, argv, o))
+    return 1;
+  if (o.kernel_bench)
+    return run_kernel_bench(o);
+  if (o.mst_bench)
+    return run_mst_bench(o);
+  if (o.delaunay_bench)
+    return run_delaunay_bench(o);
+  if (o.paths_bench)
+    return run_paths_bench(o);
+  if (o.step_bench)
+    return run_step_bench(o);
+  if (o.solver_bench)
+    return run_solver_bench(o);
+  if (o.alloc_bench)
+    return run_alloc_bench(o);
+  if (o.file_bench)
+    return run_file_bench(o);
+  if (o.chunk_bench)
+    return run_chunk_bench(o);
+  if (o.threads > 0)
+    return run_threaded(o);
+
+  std::vector<double> stage_ms[STAGE_COUNT];
+  size_t vertex_count = 0, index_count = 0;
+  uint64_t checksum = 0;
+  ewdg::Profile profile_sum;
+  size_t steps = 0, awake_body_steps = 0;
+  int step_limited = 0;
+
+  Clock::time_point total_start = Clock::now();
+  for (int n = 0; n < o.dungeons; n++) {
+    ewdg::Dungeon d(o.seed + n);
+    d.dungeon_bounds = ewdg::Vector2(o.bounds_x, o.bounds_y);
+    d.use_broadphase = !o.brute_force;
+    d.use_simd = !o.scalar;
+    d.use_sleeping = o.sleep;
+    d.parallel_simulation = o.parallel_simulation;
+    d.solver = o.solver;
+    d.solver_relaxation = o.relaxation;
+    d.max_simulation_steps = o.max_steps;
+    d.simulation_energy_threshold = o.energy_threshold;
+    d.route_corridors = o.route_corridors;
+    d.spatial_order = o.spatial_order;
+    d.union_mesh = o.union_mesh;
+
+    Clock::time_point t[STAGE_COUNT + 1];
+    t[0] = Clock::now();
+    d.generate_rooms(o.rooms, o.min_width, o.max_width);
+    t[1] = Clock::now();
+    d.simulate_rooms(o.repulsion_force, o.friction_force, o.timestep);
+    t[2] = Clock::now();
+    d.make_graf_layout(o.main_rooms, o.extra_paths);
+    t[3] = Clock::now();
+    d.generate_paths();
+    t[4] = Clock::now();
+    auto mesh = d.generate_mesh(true);
+    t[5] = Clock::now();
+
+    for (int s = 0; s < STAGE_COUNT; s++) {
+      stage_ms[s].push_back(
+          std::chrono::duration<double, std::milli>(t[s + 1] - t[s]).count());
+    }
+    vertex_count += mesh.first.size();
+    index_count += mesh.second.size();
+    checksum ^= hash_mesh(mesh.first, mesh.second) + n;
+    const ewdg::SimulationStats &stats = d.simulation_stats();
+    steps += stats.steps;
+    awake_body_steps += stats.awake_body_steps;
+    step_limited += stats.end == ewdg::SIMULATION_STEP_LIMIT;
+    for (uint32_t c = 0; c < ewdg::PROFILE_COUNTER_COUNT; c++) {
+      profile_sum.counters[c] += d.profile().counters[c];
+    }
+  }
+  double total_s =
+      std::chrono::duration<double>(Clock::now() - total_start).count();
+
+  std::printf("dungeons: %d  rooms: %d  main rooms: %d  bounds: %gx%g  "
+              "seed: %llu%s%s%s%s%s%s%s%s\n\n",
+              o.dungeons, o.rooms, o.main_rooms, o.bounds_x, o.bounds_y,
+              static_cast<unsigned long long>(o.seed),
+              o.brute_force ? "  (brute force)" : "",
+              o.scalar ? "  (scalar)" : "",
+              o.sleep ? "  (sleeping)" : "",
+              o.parallel_simulation ? "  (parallel simulation)" : "",
+              o.solver == ewdg::SOLVER_POSITIONS ? "  (positions solver)" : "",
+              o.route_corridors ? "  (routed corridors)" : "",
+              o.spatial_order ? "  (spatial order)" : "",
+              o.union_mesh ? "  (union mesh)" : "");
+  std::printf("%-18s %10s %10s %10s %10s\n", "stage", "mean ms", "min ms",
+              "max ms", "share");
+  double stage_total = 0;
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    for (double ms : stage_ms[s])
+      stage_total += ms;
+  }
+  for (int s = 0; s < STAGE_COUNT; s++) {
+    double sum = 0;
+    for (double ms : stage_ms[s])
+      sum += ms;
+    auto minmax = std::minmax_element(stage_ms[s].begin(), stage_ms[s].end());
+    std::printf("%-18s %10.3f %10.3f %10.3f %9.1f%%\n", stage_names[s],
+                sum / o.dungeons, *minmax.first, *minmax.second,
+                stage_total > 0 ? 100.0 * sum / stage_total : 0.0);
+  }
+  std::printf("\nmean vertices: %zu  mean indices: %zu  checksum: %016llx\n",
+              vertex_count / o.dungeons, index_count / o.dungeons,
+              static_cast<unsigned long long>(checksum));
+  std::printf("total: %.3f s  throughput: %.2f dungeons/s\n", total_s,
+              o.dungeons / total_s);
+  std::printf("mean simulation steps: %zu  mean awake room steps: %zu  "
+              "step limited: %d\n",
+              steps / o.dungeons, awake_body_steps / o.dungeons, step_limited);
+
+  // Only collected when built with EWDG_PROFILING
+  if (ewdg::Profiler::enabled) {
+    std::printf("\n%-18s %10s\n", "counter", "mean");
+    for (uint32_t c = 0; c < ewdg::PROFILE_COUNTER_COUNT; c++) {
+      ewdg::ProfileCounter counter = static_cast<ewdg::ProfileCounter>(c);
+      std::printf("%-18s %10.1f\n", ewdg::Profile::counter_name(counter),
+                  double(profile_sum.counters[c]) / o.dungeons);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,50 @@
+#ifndef TRIPLE_BUFFER_H_
+#define TRIPLE_BUFFER_H_
+
+#include <atomic>
+#include <cstdint>
+
+namespace ewdg {
+// Lock-free handoff of the latest value from one writer thread to one reader
+// thread. The writer fills back() and publishes it, the reader picks up the
+// most recently published value with update() and reads it through front().
+// Values published in between are skipped, neither side ever waits.
+//
+// The three slots are reused, so values that keep their capacity, like
+// vectors, stop allocating once they have grown.
+template <typename T> class TripleBuffer {
+public:
+  // Writer side
+  T &back() { return slots[back_index]; }
+
+  void publish() {
+    uint8_t previous =
+        middle.exchange(back_index | FRESH, std::memory_order_acq_rel);
+    back_index = previous & INDEX_MASK;
+  }
+
+  // Reader side. Returns true if a value was published since the last
+  // update, front() then refers to it.
+  bool update() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH))
+      return false;
+    uint8_t previous = middle.exchange(front_index, std::memory_order_acq_rel);
+    front_index = previous & INDEX_MASK;
+    return true;
+  }
+
+  const T &front() const { return slots[front_index]; }
+
+private:
+  static constexpr uint8_t INDEX_MASK = 3;
+  static constexpr uint8_t FRESH = 4;
+
+  T slots[3];
+  // Index of the slot between the two sides, FRESH while it holds a value
+  // the reader has not seen
+  std::atomic<uint8_t> middle{1};
+  uint8_t back_index = 0;
+  uint8_t front_index = 2;
+};
+} // namespace ewdg
+#endif // TRIPLE_BUFFER_H_